@@ -0,0 +1,27 @@
+#include "Arena.h"
+
+void *Arena::AllocateSlow(size_t size, size_t align)
+{
+	size_t blockSize = size + align > BlockSize ? size + align : BlockSize;
+	uint8_t* block = new uint8_t[blockSize];
+	m_Blocks.emplace_back(block);
+	m_AllocatedSize += blockSize;
+
+	uintptr_t pointer = ((uintptr_t)block + (align - 1)) & ~(uintptr_t)(align - 1);
+	if (blockSize == BlockSize)
+	{
+		m_Pointer = (uint8_t*)(pointer + size);
+		m_End = block + blockSize;
+	}
+	return (void*)pointer;
+}
+
+void Arena::Clear()
+{
+	for (size_t i = 0; i < m_Blocks.size(); i++)
+		delete[] m_Blocks[i];
+	m_Blocks.clear();
+	m_Pointer = nullptr;
+	m_End = nullptr;
+	m_AllocatedSize = 0;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <utility>
+#include <vector>
+#include <new>
+
+#include "Myassert.h"
+
+class Arena
+{
+public:
+	static const size_t BlockSize = 1024 * 1024;
+
+	Arena() {}
+	~Arena() { Clear(); }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void *Allocate(size_t size, size_t align)
+	{
+		uintptr_t pointer = ((uintptr_t)m_Pointer + (align - 1)) & ~(uintptr_t)(align - 1);
+		if (m_Pointer == nullptr || pointer + size > (uintptr_t)m_End)
+			return AllocateSlow(size, align);
+		m_Pointer = (uint8_t*)(pointer + size);
+		return (void*)pointer;
+	}
+
+	template<typename T, typename... Args>
+	T *New(Args&&... args)
+	{
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	T *NewArray(size_t count)
+	{
+		return (T*)Allocate(sizeof(T) * count, alignof(T));
+	}
+
+	char *NewString(const char* string, size_t length)
+	{
+		char* result = NewArray<char>(length + 1);
+		memcpy(result, string, length);
+		result[length] = '\0';
+		return result;
+	}
+
+	void Clear();
+	size_t GetAllocatedSize() const { return m_AllocatedSize; }
+
+private:
+	uint8_t *m_Pointer = nullptr;
+	uint8_t *m_End = nullptr;
+	size_t m_AllocatedSize = 0;
+	std::vector<uint8_t*> m_Blocks;
+
+	void *AllocateSlow(size_t size, size_t align);
+};
+
+template<typename T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	Arena *arena = nullptr;
+
+	ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T *allocate(size_t count) { return (T*)arena->Allocate(sizeof(T) * count, alignof(T) > 8 ? alignof(T) : 8); }
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif //_ARENA_H_
\ No newline at end of file
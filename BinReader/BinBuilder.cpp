@@ -0,0 +1,621 @@
+#include "BinBuilder.h"
+
+int BinBuilder::Error(const char* message)
+{
+	printf("ERROR: %s\n", message);
+	return 0;
+}
+
+BinBuilder::Frame BinBuilder::NewFrame(FrameKind kind, BinType type, BinField *node)
+{
+	Frame frame;
+	frame.kind = kind;
+	frame.type = type;
+	frame.keyType = BinType::NONE;
+	frame.valueType = BinType::NONE;
+	frame.node = node;
+	frame.pendingKey = nullptr;
+	frame.sizeOffset = 0;
+	frame.countOffset = 0;
+	frame.count = 0;
+	frame.fieldName = 0;
+	frame.hasFieldName = false;
+	frame.expectKey = true;
+	frame.isNull = false;
+	return frame;
+}
+
+int BinBuilder::BeginBin(bool isPatch, uint32_t version, uint32_t entriesCount, uint64_t unknown)
+{
+	if (m_Stage != Stage::Idle)
+		return Error("Bin already started");
+
+	m_isPatch = isPatch;
+	m_Version = version;
+	m_EntriesCount = entriesCount;
+
+	if (m_Output != nullptr)
+	{
+		if (isPatch)
+		{
+			m_Output->MemWrite((void*)"PTCH", 4);
+			m_Output->MemWrite(unknown);
+		}
+		m_Output->MemWrite((void*)"PROP", 4);
+		m_Output->MemWrite(version);
+		if (version >= 2)
+			m_LinkedCountOffset = m_Output->MemReserve(4);
+	}
+	else
+	{
+		PacketBin& packet = *m_Packet;
+		Arena& arena = packet.m_Arena;
+
+		packet.m_isPatch = isPatch;
+		packet.m_Unknown = unknown;
+		packet.m_Version = version;
+
+		Map *entriesMap = arena.New<Map>(arena);
+		entriesMap->keyType = BinType::HASH;
+		entriesMap->valueType = BinType::EMBEDDED;
+		entriesMap->items.reserve(entriesCount);
+
+		packet.m_entriesBin = NewBinField(arena, BinType::MAP, nullptr);
+		packet.m_entriesBin->data.map = entriesMap;
+
+		Map *patchMap = arena.New<Map>(arena);
+		patchMap->keyType = BinType::HASH;
+		patchMap->valueType = BinType::EMBEDDED;
+
+		packet.m_patchesBin = NewBinField(arena, BinType::MAP, nullptr);
+		packet.m_patchesBin->data.map = patchMap;
+	}
+
+	m_Stage = Stage::Linked;
+	return 1;
+}
+
+int BinBuilder::AddLinked(const char* string)
+{
+	if (m_Stage != Stage::Linked || m_Version < 2)
+		return Error("Linked files must follow BeginBin on version 2 or newer");
+
+	size_t stringLength = strlen(string);
+	if (stringLength > UINT16_MAX)
+		return Error("Linked file name is too long");
+
+	if (m_Output != nullptr)
+	{
+		m_Output->MemWrite((uint16_t)stringLength);
+		m_Output->MemWrite((void*)string, stringLength);
+	}
+	else
+		m_Packet->m_linkedList.emplace_back(string, stringLength);
+
+	m_LinkedCount++;
+	return 1;
+}
+
+void BinBuilder::StartEntries()
+{
+	if (m_Output != nullptr)
+	{
+		if (m_Version >= 2)
+			m_Output->MemPatch(m_LinkedCountOffset, m_LinkedCount);
+		m_Output->MemWrite(m_EntriesCount);
+		m_ClassesOffset = m_Output->MemReserve((size_t)m_EntriesCount * 4);
+	}
+	m_Stage = Stage::Entries;
+}
+
+int BinBuilder::BeginEntry(uint32_t keyHash, uint32_t classHash)
+{
+	if (m_Stage == Stage::Linked)
+		StartEntries();
+	if (m_Stage != Stage::Entries || !m_Frames.empty())
+		return Error("Entries must be added after the header and before patches");
+
+	Frame frame = NewFrame(FrameKind::Entry, BinType::EMBEDDED, nullptr);
+	if (m_Output != nullptr)
+	{
+		if (m_EntriesWritten >= m_EntriesCount)
+			return Error("More entries than declared in BeginBin");
+
+		m_Output->MemPatch(m_ClassesOffset + (size_t)m_EntriesWritten * 4, classHash);
+		frame.sizeOffset = m_Output->MemReserve(4);
+		m_Output->MemWrite(keyHash);
+		frame.countOffset = m_Output->MemReserve(2);
+	}
+	else
+	{
+		PacketBin& packet = *m_Packet;
+		Arena& arena = packet.m_Arena;
+
+		PointerOrEmbed *embed = arena.New<PointerOrEmbed>(arena);
+		embed->name = classHash;
+
+		BinField *embedValue = NewBinField(arena, BinType::EMBEDDED, packet.m_entriesBin);
+		embedValue->data.pe = embed;
+
+		BinField *hashKey = NewBinField(arena, BinType::HASH, packet.m_entriesBin);
+		hashKey->data.ui32 = keyHash;
+
+		MapPair pair;
+		pair.key = hashKey;
+		pair.value = embedValue;
+		packet.m_entriesBin->data.map->items.emplace_back(pair);
+
+		frame.node = embedValue;
+	}
+
+	m_EntriesWritten++;
+	m_Frames.emplace_back(frame);
+	return 1;
+}
+
+int BinBuilder::EndEntry()
+{
+	if (m_Frames.size() != 1 || m_Frames.back().kind != FrameKind::Entry)
+		return Error("EndEntry without a matching BeginEntry");
+
+	Frame& frame = m_Frames.back();
+	if (frame.hasFieldName)
+		return Error("Field has no value");
+	if (frame.count > UINT16_MAX)
+		return Error("Entry has too many fields");
+
+	if (m_Output != nullptr)
+	{
+		m_Output->MemPatch(frame.sizeOffset, (uint32_t)(m_Output->MemSize() - frame.sizeOffset - 4));
+		m_Output->MemPatch(frame.countOffset, (uint16_t)frame.count);
+	}
+
+	m_Frames.pop_back();
+	return 1;
+}
+
+int BinBuilder::BeginPatch(uint32_t keyHash, const char* path)
+{
+	if (!m_isPatch || m_Version < 3)
+		return Error("Patches need a PTCH bin of version 3 or newer");
+	if (m_Stage == Stage::Linked)
+		StartEntries();
+	if ((m_Stage != Stage::Entries && m_Stage != Stage::Patches) || !m_Frames.empty())
+		return Error("Patches must be added after the entries");
+
+	size_t pathLength = strlen(path);
+	if (pathLength > UINT16_MAX)
+		return Error("Patch path is too long");
+
+	Frame frame = NewFrame(FrameKind::Patch, BinType::EMBEDDED, nullptr);
+	if (m_Output != nullptr)
+	{
+		if (m_Stage == Stage::Entries)
+		{
+			if (m_EntriesWritten != m_EntriesCount)
+				return Error("Fewer entries than declared in BeginBin");
+			m_PatchCountOffset = m_Output->MemReserve(4);
+		}
+
+		m_Output->MemWrite(keyHash);
+		frame.sizeOffset = m_Output->MemReserve(4);
+		m_PatchPath.assign(path, pathLength);
+	}
+	else
+	{
+		PacketBin& packet = *m_Packet;
+		Arena& arena = packet.m_Arena;
+
+		PointerOrEmbed *embed = arena.New<PointerOrEmbed>(arena);
+		embed->name = patchFNV;
+
+		BinField *embedValue = NewBinField(arena, BinType::EMBEDDED, packet.m_patchesBin);
+		embedValue->data.pe = embed;
+
+		BinField *stringBin = NewBinField(arena, BinType::STRING, embedValue);
+		stringBin->data.string = arena.NewString(path, pathLength);
+
+		EPField pathField;
+		pathField.key = pathFNV;
+		pathField.value = stringBin;
+		embed->items.emplace_back(pathField);
+
+		BinField *hashKey = NewBinField(arena, BinType::HASH, packet.m_patchesBin);
+		hashKey->data.ui32 = keyHash;
+
+		MapPair pair;
+		pair.key = hashKey;
+		pair.value = embedValue;
+		packet.m_patchesBin->data.map->items.emplace_back(pair);
+
+		frame.node = embedValue;
+	}
+
+	m_Stage = Stage::Patches;
+	m_Frames.emplace_back(frame);
+	return 1;
+}
+
+int BinBuilder::EndPatch()
+{
+	if (m_Frames.size() != 1 || m_Frames.back().kind != FrameKind::Patch)
+		return Error("EndPatch without a matching BeginPatch");
+
+	Frame& frame = m_Frames.back();
+	if (frame.count != 1)
+		return Error("Patch has no value");
+
+	if (m_Output != nullptr)
+		m_Output->MemPatch(frame.sizeOffset, (uint32_t)(m_Output->MemSize() - frame.sizeOffset - 4));
+
+	m_PatchCount++;
+	m_Frames.pop_back();
+	return 1;
+}
+
+int BinBuilder::EndBin()
+{
+	if (m_Stage == Stage::Idle || m_Stage == Stage::Done || !m_Frames.empty())
+		return Error("EndBin without a matching BeginBin or with open values");
+	if (m_Stage == Stage::Linked)
+		StartEntries();
+
+	if (m_Output != nullptr)
+	{
+		if (m_Stage == Stage::Entries && m_EntriesWritten != m_EntriesCount)
+			return Error("Fewer entries than declared in BeginBin");
+
+		if (m_isPatch && m_Version >= 3)
+		{
+			if (m_Stage == Stage::Patches)
+				m_Output->MemPatch(m_PatchCountOffset, m_PatchCount);
+			else
+				m_Output->MemWrite(m_PatchCount);
+		}
+	}
+
+	m_Stage = Stage::Done;
+	return 1;
+}
+
+int BinBuilder::Field(uint32_t name)
+{
+	if (m_Frames.empty())
+		return Error("Field outside of an entry");
+
+	Frame& frame = m_Frames.back();
+	if (frame.kind == FrameKind::Patch || !IsPointerOrEmbedded(frame.type))
+		return Error("Field outside of an entry, pointer or embed");
+	if (frame.kind == FrameKind::Value && frame.isNull)
+		return Error("Null pointer cannot have fields");
+	if (frame.hasFieldName)
+		return Error("Field has no value");
+
+	frame.fieldName = name;
+	frame.hasFieldName = true;
+	return 1;
+}
+
+int BinBuilder::BeginValue(BinType type)
+{
+	if (m_Frames.empty())
+		return Error("Value outside of an entry or patch");
+
+	Frame& frame = m_Frames.back();
+	switch (frame.kind)
+	{
+		case FrameKind::Entry:
+		{
+			if (!frame.hasFieldName)
+				return Error("Value has no field name");
+			break;
+		}
+		case FrameKind::Patch:
+		{
+			if (frame.count != 0)
+				return Error("Patch already has a value");
+			break;
+		}
+		case FrameKind::Value:
+		{
+			switch (frame.type)
+			{
+				case BinType::POINTER:
+				case BinType::EMBEDDED:
+				{
+					if (!frame.hasFieldName)
+						return Error("Value has no field name");
+					break;
+				}
+				case BinType::OPTION:
+				{
+					if (frame.count != 0)
+						return Error("Option already has a value");
+					if (type != frame.valueType)
+						return Error("Value type does not match the option type");
+					break;
+				}
+				case BinType::CONTAINER:
+				case BinType::STRUCT:
+				{
+					if (type != frame.valueType)
+						return Error("Value type does not match the container type");
+					break;
+				}
+				case BinType::MAP:
+				{
+					if (type != (frame.expectKey ? frame.keyType : frame.valueType))
+						return Error("Value type does not match the map type");
+					break;
+				}
+			}
+			break;
+		}
+	}
+
+	if (m_Output != nullptr)
+	{
+		uint8_t typeValue = TypeToUint8(type);
+		if (frame.kind == FrameKind::Patch)
+		{
+			m_Output->MemWrite(typeValue);
+			m_Output->MemWrite((uint16_t)m_PatchPath.size());
+			m_Output->MemWrite(m_PatchPath.data(), m_PatchPath.size());
+		}
+		else if (IsPointerOrEmbedded(frame.type))
+		{
+			m_Output->MemWrite(frame.fieldName);
+			m_Output->MemWrite(typeValue);
+		}
+	}
+	return 1;
+}
+
+void BinBuilder::AttachValue(BinField *value)
+{
+	Frame& frame = m_Frames.back();
+	if (frame.kind == FrameKind::Patch)
+	{
+		EPField field;
+		field.key = valueFNV;
+		field.value = value;
+		frame.node->data.pe->items.emplace_back(field);
+		return;
+	}
+
+	switch (frame.type)
+	{
+		case BinType::POINTER:
+		case BinType::EMBEDDED:
+		{
+			EPField field;
+			field.key = frame.fieldName;
+			field.value = value;
+			frame.node->data.pe->items.emplace_back(field);
+			break;
+		}
+		case BinType::CONTAINER:
+		case BinType::STRUCT:
+		case BinType::OPTION:
+		{
+			frame.node->data.cso->items.emplace_back(value);
+			break;
+		}
+		case BinType::MAP:
+		{
+			if (frame.expectKey)
+			{
+				frame.pendingKey = value;
+				break;
+			}
+
+			MapPair pair;
+			pair.key = frame.pendingKey;
+			pair.value = value;
+			frame.node->data.map->items.emplace_back(pair);
+			break;
+		}
+	}
+}
+
+void BinBuilder::EndValue()
+{
+	Frame& frame = m_Frames.back();
+	if (frame.type == BinType::MAP && frame.kind == FrameKind::Value)
+	{
+		frame.expectKey = !frame.expectKey;
+		if (!frame.expectKey)
+			return;
+	}
+	frame.hasFieldName = false;
+	frame.count++;
+}
+
+int BinBuilder::AddValue(BinType type, const void* data)
+{
+	if (IsComplexBinType(type) || type == BinType::NONE)
+		return Error("Complex values need a Begin call");
+	if (!BeginValue(type))
+		return 0;
+
+	if (m_Output != nullptr)
+	{
+		if (type == BinType::STRING)
+		{
+			size_t stringLength = strlen((const char*)data);
+			if (stringLength > UINT16_MAX)
+				return Error("String is too long");
+			m_Output->MemWrite((uint16_t)stringLength);
+			m_Output->MemWrite((void*)data, stringLength);
+		}
+		else
+			m_Output->MemWrite((void*)data, Type_size[(uint8_t)type]);
+
+		EndValue();
+		return 1;
+	}
+
+	Frame& frame = m_Frames.back();
+	Arena& arena = m_Packet->m_Arena;
+
+	BinField value;
+	value.type = type;
+	value.parent = frame.node;
+	if (type == BinType::MTX44)
+		value.data.mtx = (float*)data;
+	else if (type == BinType::STRING)
+		value.data.string = (char*)data;
+	else
+		memcpy(&value.data, data, Type_size[(uint8_t)type]);
+
+	if (frame.kind == FrameKind::Value && !IsPointerOrEmbedded(frame.type) &&
+		frame.type != BinType::MAP && IsPackedBinType(type))
+		AppendPackedItem(frame.node->data.cso, &value);
+	else
+		AttachValue(CloneBinField(arena, &value, frame.node));
+
+	EndValue();
+	return 1;
+}
+
+int BinBuilder::BeginContainer(BinType type, BinType valueType)
+{
+	if (type != BinType::CONTAINER && type != BinType::STRUCT && type != BinType::OPTION)
+		return Error("BeginContainer needs a container, struct or option type");
+	if (valueType == BinType::NONE)
+		return Error("Container value type cannot be none");
+	if (!BeginValue(type))
+		return 0;
+
+	Frame frame = NewFrame(FrameKind::Value, type, nullptr);
+	frame.valueType = valueType;
+	if (m_Output != nullptr)
+	{
+		m_Output->MemWrite(TypeToUint8(valueType));
+		if (type == BinType::OPTION)
+			frame.countOffset = m_Output->MemReserve(1);
+		else
+		{
+			frame.sizeOffset = m_Output->MemReserve(4);
+			frame.countOffset = m_Output->MemReserve(4);
+		}
+	}
+	else
+	{
+		Arena& arena = m_Packet->m_Arena;
+		ContainerOrStructOrOption *cs = arena.New<ContainerOrStructOrOption>(arena);
+		cs->valueType = valueType;
+
+		frame.node = NewBinField(arena, type, m_Frames.back().node);
+		frame.node->data.cso = cs;
+		AttachValue(frame.node);
+	}
+
+	m_Frames.emplace_back(frame);
+	return 1;
+}
+
+int BinBuilder::BeginEmbed(BinType type, uint32_t name)
+{
+	if (!IsPointerOrEmbedded(type))
+		return Error("BeginEmbed needs a pointer or embed type");
+	if (!BeginValue(type))
+		return 0;
+
+	Frame frame = NewFrame(FrameKind::Value, type, nullptr);
+	frame.isNull = name == 0;
+	if (m_Output != nullptr)
+	{
+		m_Output->MemWrite(name);
+		if (name != 0)
+		{
+			frame.sizeOffset = m_Output->MemReserve(4);
+			frame.countOffset = m_Output->MemReserve(2);
+		}
+	}
+	else
+	{
+		Arena& arena = m_Packet->m_Arena;
+		PointerOrEmbed *pe = arena.New<PointerOrEmbed>(arena);
+		pe->name = name;
+
+		frame.node = NewBinField(arena, type, m_Frames.back().node);
+		frame.node->data.pe = pe;
+		AttachValue(frame.node);
+	}
+
+	m_Frames.emplace_back(frame);
+	return 1;
+}
+
+int BinBuilder::BeginMap(BinType keyType, BinType valueType)
+{
+	if (IsComplexBinType(keyType) || keyType == BinType::NONE || valueType == BinType::NONE)
+		return Error("Map keys must be primitive types");
+	if (!BeginValue(BinType::MAP))
+		return 0;
+
+	Frame frame = NewFrame(FrameKind::Value, BinType::MAP, nullptr);
+	frame.keyType = keyType;
+	frame.valueType = valueType;
+	if (m_Output != nullptr)
+	{
+		m_Output->MemWrite(TypeToUint8(keyType));
+		m_Output->MemWrite(TypeToUint8(valueType));
+		frame.sizeOffset = m_Output->MemReserve(4);
+		frame.countOffset = m_Output->MemReserve(4);
+	}
+	else
+	{
+		Arena& arena = m_Packet->m_Arena;
+		Map *map = arena.New<Map>(arena);
+		map->keyType = keyType;
+		map->valueType = valueType;
+
+		frame.node = NewBinField(arena, BinType::MAP, m_Frames.back().node);
+		frame.node->data.map = map;
+		AttachValue(frame.node);
+	}
+
+	m_Frames.emplace_back(frame);
+	return 1;
+}
+
+int BinBuilder::End()
+{
+	if (m_Frames.empty() || m_Frames.back().kind != FrameKind::Value)
+		return Error("End without a matching Begin");
+
+	Frame& frame = m_Frames.back();
+	if (frame.hasFieldName)
+		return Error("Field has no value");
+	if (frame.type == BinType::MAP && !frame.expectKey)
+		return Error("Map key has no value");
+
+	if (m_Output != nullptr)
+	{
+		switch (frame.type)
+		{
+			case BinType::OPTION:
+				m_Output->MemPatch(frame.countOffset, (uint8_t)frame.count);
+				break;
+			case BinType::POINTER:
+			case BinType::EMBEDDED:
+				if (frame.isNull)
+					break;
+				if (frame.count > UINT16_MAX)
+					return Error("Embed has too many fields");
+				m_Output->MemPatch(frame.sizeOffset, (uint32_t)(m_Output->MemSize() - frame.sizeOffset - 4));
+				m_Output->MemPatch(frame.countOffset, (uint16_t)frame.count);
+				break;
+			default:
+				m_Output->MemPatch(frame.sizeOffset, (uint32_t)(m_Output->MemSize() - frame.sizeOffset - 4));
+				m_Output->MemPatch(frame.countOffset, frame.count);
+				break;
+		}
+	}
+
+	m_Frames.pop_back();
+	EndValue();
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef _BINBUILDER_H_
+#define _BINBUILDER_H_
+
+#include "BinReader.h"
+
+// Builds a bin either into a PacketBin tree or straight into a CharMemVector,
+// streaming needs the entry count up front since class hashes precede the entries
+class BinBuilder
+{
+public:
+	BinBuilder(PacketBin& packet) : m_Packet(&packet) {}
+	BinBuilder(CharMemVector& output) : m_Output(&output) {}
+
+	BinBuilder(const BinBuilder&) = delete;
+	BinBuilder& operator=(const BinBuilder&) = delete;
+
+	int BeginBin(bool isPatch, uint32_t version, uint32_t entriesCount = 0, uint64_t unknown = 0);
+	int AddLinked(const char* string);
+	int BeginEntry(uint32_t keyHash, uint32_t classHash);
+	int EndEntry();
+	int BeginPatch(uint32_t keyHash, const char* path);
+	int EndPatch();
+	int EndBin();
+
+	int Field(uint32_t name);
+	int AddValue(BinType type, const void* data);
+
+	int AddBool(bool value) { return AddValue(BinType::BOOLB, &value); }
+	int AddSInt8(int8_t value) { return AddValue(BinType::SInt8, &value); }
+	int AddUInt8(uint8_t value) { return AddValue(BinType::UInt8, &value); }
+	int AddSInt16(int16_t value) { return AddValue(BinType::SInt16, &value); }
+	int AddUInt16(uint16_t value) { return AddValue(BinType::UInt16, &value); }
+	int AddSInt32(int32_t value) { return AddValue(BinType::SInt32, &value); }
+	int AddUInt32(uint32_t value) { return AddValue(BinType::UInt32, &value); }
+	int AddSInt64(int64_t value) { return AddValue(BinType::SInt64, &value); }
+	int AddUInt64(uint64_t value) { return AddValue(BinType::UInt64, &value); }
+	int AddFloat32(float value) { return AddValue(BinType::Float32, &value); }
+	int AddVec2(const float* value) { return AddValue(BinType::VEC2, value); }
+	int AddVec3(const float* value) { return AddValue(BinType::VEC3, value); }
+	int AddVec4(const float* value) { return AddValue(BinType::VEC4, value); }
+	int AddMtx44(const float* value) { return AddValue(BinType::MTX44, value); }
+	int AddRGBA(const uint8_t* value) { return AddValue(BinType::RGBA, value); }
+	int AddString(const char* value) { return AddValue(BinType::STRING, value); }
+	int AddHash(uint32_t value) { return AddValue(BinType::HASH, &value); }
+	int AddWadEntryLink(uint64_t value) { return AddValue(BinType::WADENTRYLINK, &value); }
+	int AddLink(uint32_t value) { return AddValue(BinType::LINK, &value); }
+	int AddFlag(bool value) { return AddValue(BinType::FLAG, &value); }
+
+	int BeginContainer(BinType type, BinType valueType);
+	int BeginEmbed(BinType type, uint32_t name);
+	int BeginMap(BinType keyType, BinType valueType);
+	int End();
+
+private:
+	enum class FrameKind : uint8_t { Entry, Patch, Value };
+	enum class Stage : uint8_t { Idle, Linked, Entries, Patches, Done };
+
+	struct Frame
+	{
+		FrameKind kind;
+		BinType type;
+		BinType keyType;
+		BinType valueType;
+		BinField *node;
+		BinField *pendingKey;
+		size_t sizeOffset;
+		size_t countOffset;
+		uint32_t count;
+		uint32_t fieldName;
+		bool hasFieldName;
+		bool expectKey;
+		bool isNull;
+	};
+
+	PacketBin *m_Packet = nullptr;
+	CharMemVector *m_Output = nullptr;
+	std::vector<Frame> m_Frames;
+	Stage m_Stage = Stage::Idle;
+
+	bool m_isPatch = false;
+	uint32_t m_Version = 0;
+	uint32_t m_EntriesCount = 0;
+	uint32_t m_EntriesWritten = 0;
+	uint32_t m_LinkedCount = 0;
+	uint32_t m_PatchCount = 0;
+	size_t m_LinkedCountOffset = 0;
+	size_t m_ClassesOffset = 0;
+	size_t m_PatchCountOffset = 0;
+	std::string m_PatchPath;
+
+	int Error(const char* message);
+	void StartEntries();
+	Frame NewFrame(FrameKind kind, BinType type, BinField *node);
+	int BeginValue(BinType type);
+	void AttachValue(BinField *value);
+	void EndValue();
+};
+
+#endif //_BINBUILDER_H_
\ No newline at end of file
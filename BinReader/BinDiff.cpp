@@ -0,0 +1,276 @@
+#include "BinDiff.h"
+
+static uint64_t HashCombine(uint64_t seed, uint64_t value)
+{
+	seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4);
+	return seed;
+}
+
+static std::string HashStep(const char* format, uint64_t value)
+{
+	char step[32];
+	myassert(sprintf_s(step, 32, format, value) <= 0)
+	return step;
+}
+
+static std::string FieldPath(const std::string& path, uint32_t name)
+{
+	return path + HashStep("/0x%08" PRIX64, name);
+}
+
+static std::string KeyPath(const std::string& path, const BinField *key)
+{
+	switch (key->type)
+	{
+		case BinType::STRING:
+			return path + "[\"" + key->data.string + "\"]";
+		case BinType::HASH:
+		case BinType::LINK:
+			return path + HashStep("[0x%08" PRIX64 "]", key->data.ui32);
+		case BinType::WADENTRYLINK:
+			return path + HashStep("[0x%016" PRIX64 "]", key->data.ui64);
+	}
+	return path + HashStep("[%" PRId64 "]", GetMapKeyValue(key));
+}
+
+uint64_t BinDiff::GetHash(const BinField *value)
+{
+	auto found = m_Hashes.find(value);
+	if (found != m_Hashes.end())
+		return found->second;
+
+	uint64_t hash = (uint64_t)value->type;
+	if (IsPackedBinType(value->type))
+	{
+		const char* data = value->type == BinType::MTX44 ? (const char*)value->data.mtx : (const char*)&value->data;
+		hash = HashCombine(hash, XXHash(data, Type_size[(uint8_t)value->type]));
+	}
+	else
+	{
+		switch (value->type)
+		{
+			case BinType::STRING:
+			{
+				hash = HashCombine(hash, XXHash(value->data.string, strlen(value->data.string)));
+				break;
+			}
+			case BinType::CONTAINER:
+			case BinType::STRUCT:
+			case BinType::OPTION:
+			{
+				ContainerOrStructOrOption *cs = value->data.cso;
+				hash = HashCombine(hash, (uint64_t)cs->valueType);
+				hash = HashCombine(hash, XXHash((const char*)cs->packed.data(), cs->packed.size()));
+				for (size_t i = 0; i < cs->items.size(); i++)
+					hash = HashCombine(hash, GetHash(cs->items[i]));
+				break;
+			}
+			case BinType::POINTER:
+			case BinType::EMBEDDED:
+			{
+				PointerOrEmbed *pe = value->data.pe;
+				hash = HashCombine(hash, pe->name);
+				for (size_t i = 0; i < pe->items.size(); i++)
+				{
+					hash = HashCombine(hash, pe->items[i].key);
+					hash = HashCombine(hash, GetHash(pe->items[i].value));
+				}
+				break;
+			}
+			case BinType::MAP:
+			{
+				Map *map = value->data.map;
+				hash = HashCombine(hash, (uint64_t)map->keyType << 8 | (uint64_t)map->valueType);
+				for (size_t i = 0; i < map->items.size(); i++)
+				{
+					hash = HashCombine(hash, GetHash(map->items[i].key));
+					hash = HashCombine(hash, GetHash(map->items[i].value));
+				}
+				break;
+			}
+		}
+	}
+
+	m_Hashes.emplace(value, hash);
+	return hash;
+}
+
+void BinDiff::AddChange(DiffKind kind, uint32_t entryKey, const std::string& path, BinField *oldValue, BinField *newValue)
+{
+	DiffChange change;
+	change.kind = kind;
+	change.entryKey = entryKey;
+	change.path = path;
+	change.oldValue = oldValue;
+	change.newValue = newValue;
+	m_Changes->emplace_back(change);
+}
+
+void BinDiff::DiffEmbed(uint32_t entryKey, const std::string& path, PointerOrEmbed *oldPe, PointerOrEmbed *newPe)
+{
+	// Repeated keys pair up in order, remember where the previous occurrence of each key matched
+	std::unordered_map<uint32_t, uint32_t> previous;
+	std::vector<bool> matched(newPe->items.size(), false);
+	for (size_t i = 0; i < oldPe->items.size(); i++)
+	{
+		uint32_t key = oldPe->items[i].key;
+
+		size_t found = SIZE_MAX;
+		auto it = previous.find(key);
+		if (it == previous.end())
+			found = newPe->FindItem(key);
+		else if (it->second != UINT32_MAX)
+		{
+			for (size_t k = it->second + 1; k < newPe->items.size(); k++)
+			{
+				if (newPe->items[k].key == key)
+				{
+					found = k;
+					break;
+				}
+			}
+		}
+		previous[key] = found == SIZE_MAX ? UINT32_MAX : (uint32_t)found;
+
+		std::string fieldPath = FieldPath(path, key);
+		if (found == SIZE_MAX)
+		{
+			AddChange(DiffKind::Removed, entryKey, fieldPath, oldPe->items[i].value, nullptr);
+			continue;
+		}
+
+		matched[found] = true;
+		DiffValue(entryKey, fieldPath, oldPe->items[i].value, newPe->items[found].value);
+	}
+
+	for (size_t i = 0; i < newPe->items.size(); i++)
+		if (!matched[i])
+			AddChange(DiffKind::Added, entryKey, FieldPath(path, newPe->items[i].key), nullptr, newPe->items[i].value);
+}
+
+void BinDiff::DiffValue(uint32_t entryKey, const std::string& path, BinField *oldValue, BinField *newValue)
+{
+	if (oldValue == newValue || GetHash(oldValue) == GetHash(newValue))
+		return;
+
+	if (oldValue->type == newValue->type)
+	{
+		switch (oldValue->type)
+		{
+			case BinType::POINTER:
+			case BinType::EMBEDDED:
+			{
+				if (oldValue->data.pe->name != newValue->data.pe->name)
+					break;
+				DiffEmbed(entryKey, path, oldValue->data.pe, newValue->data.pe);
+				return;
+			}
+			case BinType::CONTAINER:
+			case BinType::STRUCT:
+			case BinType::OPTION:
+			{
+				ContainerOrStructOrOption *oldCs = oldValue->data.cso;
+				ContainerOrStructOrOption *newCs = newValue->data.cso;
+				if (oldCs->valueType != newCs->valueType || IsPackedBinType(oldCs->valueType))
+					break;
+
+				size_t common = std::min(oldCs->items.size(), newCs->items.size());
+				for (size_t i = 0; i < common; i++)
+					DiffValue(entryKey, path + HashStep("[%" PRIu64 "]", i), oldCs->items[i], newCs->items[i]);
+				for (size_t i = common; i < oldCs->items.size(); i++)
+					AddChange(DiffKind::Removed, entryKey, path + HashStep("[%" PRIu64 "]", i), oldCs->items[i], nullptr);
+				for (size_t i = common; i < newCs->items.size(); i++)
+					AddChange(DiffKind::Added, entryKey, path + HashStep("[%" PRIu64 "]", i), nullptr, newCs->items[i]);
+				return;
+			}
+			case BinType::MAP:
+			{
+				Map *oldMap = oldValue->data.map;
+				Map *newMap = newValue->data.map;
+				if (oldMap->keyType != newMap->keyType || oldMap->valueType != newMap->valueType)
+					break;
+
+				std::vector<bool> matched(newMap->items.size(), false);
+				for (size_t i = 0; i < oldMap->items.size(); i++)
+				{
+					BinField *key = oldMap->items[i].key;
+					size_t found = newMap->FindItem(GetMapKeyValue(key));
+					if (found == SIZE_MAX || GetHash(newMap->items[found].key) != GetHash(key))
+					{
+						AddChange(DiffKind::Removed, entryKey, KeyPath(path, key), oldMap->items[i].value, nullptr);
+						continue;
+					}
+
+					matched[found] = true;
+					DiffValue(entryKey, KeyPath(path, key), oldMap->items[i].value, newMap->items[found].value);
+				}
+
+				for (size_t i = 0; i < newMap->items.size(); i++)
+					if (!matched[i])
+						AddChange(DiffKind::Added, entryKey, KeyPath(path, newMap->items[i].key), nullptr, newMap->items[i].value);
+				return;
+			}
+		}
+	}
+
+	AddChange(DiffKind::Changed, entryKey, path, oldValue, newValue);
+}
+
+void BinDiff::Run(PacketBin& oldBin, PacketBin& newBin, std::vector<DiffChange>& changes)
+{
+	m_Changes = &changes;
+
+	Map *oldEntries = oldBin.m_entriesBin->data.map;
+	Map *newEntries = newBin.m_entriesBin->data.map;
+
+	std::vector<size_t> newIndexes(oldEntries->items.size(), SIZE_MAX);
+	std::vector<bool> matched(newEntries->items.size(), false);
+	for (size_t i = 0; i < oldEntries->items.size(); i++)
+	{
+		size_t index;
+		if (newBin.FindEntryIndex(oldEntries->items[i].key->data.ui32, index) && !matched[index])
+		{
+			newIndexes[i] = index;
+			matched[index] = true;
+		}
+	}
+
+	std::vector<bool> same(oldEntries->items.size(), false);
+	RunThreads(GetThreadCount(oldEntries->items.size()), oldEntries->items.size(), [&](size_t t, size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+			if (newIndexes[i] != SIZE_MAX)
+				same[i] = oldBin.GetEntryHash(i) == newBin.GetEntryHash(newIndexes[i]);
+	});
+
+	for (size_t i = 0; i < oldEntries->items.size(); i++)
+	{
+		uint32_t entryKey = oldEntries->items[i].key->data.ui32;
+		std::string path = HashStep("0x%08" PRIX64, entryKey);
+
+		if (newIndexes[i] == SIZE_MAX)
+		{
+			AddChange(DiffKind::Removed, entryKey, path, oldBin.GetEntry(i), nullptr);
+			continue;
+		}
+		if (same[i])
+		{
+			m_SkippedEntries++;
+			continue;
+		}
+
+		BinField *oldEntry = oldBin.GetEntry(i);
+		BinField *newEntry = newBin.GetEntry(newIndexes[i]);
+		if (oldEntry->data.pe->name != newEntry->data.pe->name)
+			AddChange(DiffKind::Changed, entryKey, path, oldEntry, newEntry);
+		else
+			DiffEmbed(entryKey, path, oldEntry->data.pe, newEntry->data.pe);
+	}
+
+	for (size_t i = 0; i < newEntries->items.size(); i++)
+		if (!matched[i])
+			AddChange(DiffKind::Added, newEntries->items[i].key->data.ui32, HashStep("0x%08" PRIX64, newEntries->items[i].key->data.ui32), nullptr, newBin.GetEntry(i));
+
+	m_Hashes.clear();
+	m_Changes = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef _BINDIFF_H_
+#define _BINDIFF_H_
+
+#include "BinReader.h"
+
+enum class DiffKind : uint8_t { Added, Removed, Changed };
+
+// Paths use the BinQuery syntax with hex hashes so they can be fed back to -q,
+// values point into the packets, packed container items are reported as whole containers
+struct DiffChange
+{
+	DiffKind kind = DiffKind::Changed;
+	uint32_t entryKey = 0;
+	std::string path;
+	BinField *oldValue = nullptr;
+	BinField *newValue = nullptr;
+};
+
+class BinDiff
+{
+public:
+	size_t m_SkippedEntries = 0;
+
+	void Run(PacketBin& oldBin, PacketBin& newBin, std::vector<DiffChange>& changes);
+
+private:
+	std::unordered_map<const BinField*, uint64_t> m_Hashes;
+	std::vector<DiffChange> *m_Changes = nullptr;
+
+	uint64_t GetHash(const BinField *value);
+	void AddChange(DiffKind kind, uint32_t entryKey, const std::string& path, BinField *oldValue, BinField *newValue);
+	void DiffEmbed(uint32_t entryKey, const std::string& path, PointerOrEmbed *oldPe, PointerOrEmbed *newPe);
+	void DiffValue(uint32_t entryKey, const std::string& path, BinField *oldValue, BinField *newValue);
+};
+
+#endif //_BINDIFF_H_
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "BinPatch.h"
+#include <cctype>
+#include <cerrno>
+
+// Numbers are decimal unless 0x prefixed, the whole token has to be a number
+static int ParsePathNumber(const char* string, size_t length, uint32_t& value)
+{
+	int base = 10;
+	if (length > 2 && string[0] == '0' && (string[1] == 'x' || string[1] == 'X'))
+	{
+		string += 2;
+		length -= 2;
+		base = 16;
+	}
+	if (length == 0 || !(base == 16 ? isxdigit((unsigned char)string[0]) : isdigit((unsigned char)string[0])))
+		return 0;
+
+	std::string number(string, length);
+	char* end;
+	errno = 0;
+	unsigned long long parsed = strtoull(number.c_str(), &end, base);
+	if (*end != '\0' || errno == ERANGE || parsed > UINT32_MAX)
+		return 0;
+	value = (uint32_t)parsed;
+	return 1;
+}
+
+static int CompilePathSegment(const char* segment, size_t length, std::vector<PatchStep>& steps)
+{
+	if (length == 0)
+		return 0;
+
+	size_t nameLength = 0;
+	while (nameLength < length && segment[nameLength] != '[')
+		nameLength++;
+
+	if (nameLength > 0)
+	{
+		PatchStep step;
+		if (nameLength > 2 && segment[0] == '0' && (segment[1] == 'x' || segment[1] == 'X'))
+		{
+			if (!ParsePathNumber(segment, nameLength, step.value))
+				return 0;
+		}
+		else
+			step.value = FNV1Hash(segment, nameLength);
+		steps.emplace_back(step);
+	}
+
+	size_t position = nameLength;
+	while (position < length)
+	{
+		const char* close = (const char*)memchr(segment + position, ']', length - position);
+		if (segment[position] != '[' || close == nullptr)
+			return 0;
+
+		PatchStep step;
+		step.isIndex = true;
+		if (!ParsePathNumber(segment + position + 1, close - segment - position - 1, step.value))
+			return 0;
+		steps.emplace_back(step);
+
+		position = close - segment + 1;
+	}
+	return 1;
+}
+
+uint32_t BinPatcher::CompilePath(const char* path)
+{
+	auto found = m_PathIds.find(path);
+	if (found != m_PathIds.end())
+		return found->second;
+
+	CompiledPath compiled;
+	compiled.valid = true;
+
+	const char* segment = path;
+	while (compiled.valid)
+	{
+		const char* dot = strchr(segment, '.');
+		size_t length = dot != nullptr ? (size_t)(dot - segment) : strlen(segment);
+		compiled.valid = CompilePathSegment(segment, length, compiled.steps);
+		if (dot == nullptr)
+			break;
+		segment = dot + 1;
+	}
+
+	uint32_t pathId = (uint32_t)m_Paths.size();
+	m_Paths.emplace_back(compiled);
+	m_PathIds.emplace(path, pathId);
+	return pathId;
+}
+
+int BinPatcher::AddPatch(PacketBin& patch)
+{
+	if (!patch.m_isPatch)
+	{
+		printf("ERROR: Bin is not a patch\n");
+		return 0;
+	}
+
+	Map *patchMap = patch.m_patchesBin->data.map;
+	m_Pending.reserve(m_Pending.size() + patchMap->items.size());
+	for (size_t i = 0; i < patchMap->items.size(); i++)
+	{
+		PointerOrEmbed *pe = patchMap->items[i].value->data.pe;
+
+		PendingPatch pending;
+		pending.keyHash = patchMap->items[i].key->data.ui32;
+		pending.path = pe->items[0].value->data.string;
+		pending.pathId = CompilePath(pending.path);
+		pending.value = pe->items[1].value;
+		m_Pending.emplace_back(pending);
+	}
+	return 1;
+}
+
+int BinPatcher::ApplyPatch(const PendingPatch& patch)
+{
+	const CompiledPath& path = m_Paths[patch.pathId];
+	size_t entryIndex;
+	if (!path.valid || !m_Base.FindEntryIndex(patch.keyHash, entryIndex))
+		return 0;
+
+	BinField *node = m_Base.GetEntry(entryIndex);
+	for (size_t i = 0; i < path.steps.size(); i++)
+	{
+		const PatchStep& step = path.steps[i];
+		bool last = i + 1 == path.steps.size();
+
+		BinField **slot = nullptr;
+		switch (node->type)
+		{
+			case BinType::POINTER:
+			case BinType::EMBEDDED:
+			{
+				if (step.isIndex)
+					return 0;
+
+				PointerOrEmbed *pe = node->data.pe;
+				size_t found = pe->FindItem(step.value);
+				if (found != SIZE_MAX)
+					slot = &pe->items[found].value;
+
+				if (slot == nullptr && last)
+				{
+					EPField field;
+					field.key = step.value;
+					field.value = nullptr;
+					pe->items.emplace_back(field);
+					slot = &pe->items.back().value;
+				}
+				break;
+			}
+			case BinType::CONTAINER:
+			case BinType::STRUCT:
+			case BinType::OPTION:
+			{
+				ContainerOrStructOrOption *cs = node->data.cso;
+				if (!step.isIndex || step.value >= GetItemCount(cs))
+					return 0;
+
+				if (IsPackedBinType(cs->valueType))
+				{
+					if (!last || patch.value->type != cs->valueType)
+						return 0;
+
+					size_t size = Type_size[(uint8_t)cs->valueType];
+					const uint8_t *data = (const uint8_t*)&patch.value->data;
+					if (patch.value->type == BinType::MTX44)
+						data = (const uint8_t*)patch.value->data.mtx;
+					memcpy(cs->packed.data() + step.value * size, data, size);
+
+					m_Base.MarkEntryDirty(entryIndex);
+					return 1;
+				}
+				if (last && patch.value->type != cs->valueType)
+					return 0;
+				slot = &cs->items[step.value];
+				break;
+			}
+			case BinType::MAP:
+			{
+				Map *map = node->data.map;
+				if (last && patch.value->type != map->valueType)
+					return 0;
+				size_t found = map->FindItem(step.value);
+				if (found != SIZE_MAX)
+					slot = &map->items[found].value;
+				break;
+			}
+		}
+
+		if (slot == nullptr)
+			return 0;
+
+		if (last)
+		{
+			*slot = CloneBinField(m_Base.m_Arena, patch.value, node);
+			m_Base.MarkEntryDirty(entryIndex);
+			return 1;
+		}
+		node = MakeWritable(m_Base.m_Arena, *slot, node);
+	}
+	return 0;
+}
+
+void BinPatcher::Apply()
+{
+	std::unordered_map<uint64_t, size_t> lastWrites;
+	lastWrites.reserve(m_Pending.size());
+	for (size_t i = 0; i < m_Pending.size(); i++)
+		lastWrites[(uint64_t)m_Pending[i].keyHash << 32 | m_Pending[i].pathId] = i;
+
+	for (size_t i = 0; i < m_Pending.size(); i++)
+	{
+		const PendingPatch& patch = m_Pending[i];
+		if (lastWrites[(uint64_t)patch.keyHash << 32 | patch.pathId] != i)
+			continue;
+
+		if (ApplyPatch(patch))
+			m_Applied++;
+		else
+		{
+			printf("Cannot apply patch 0x%08" PRIX32 " %s\n", patch.keyHash, patch.path);
+			m_Skipped++;
+		}
+	}
+	m_Pending.clear();
+}
\ No newline at end of file
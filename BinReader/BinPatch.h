@@ -0,0 +1,48 @@
+#ifndef _BINPATCH_H_
+#define _BINPATCH_H_
+
+#include "BinReader.h"
+
+struct PatchStep
+{
+	uint32_t value = 0;
+	bool isIndex = false;
+};
+
+struct CompiledPath
+{
+	std::vector<PatchStep> steps;
+	bool valid = false;
+};
+
+// Patches are applied in the order they were added, the patch packets must outlive Apply
+class BinPatcher
+{
+public:
+	size_t m_Applied = 0;
+	size_t m_Skipped = 0;
+
+	BinPatcher(PacketBin& base) : m_Base(base) {}
+
+	int AddPatch(PacketBin& patch);
+	void Apply();
+
+private:
+	struct PendingPatch
+	{
+		uint32_t keyHash;
+		uint32_t pathId;
+		const char* path;
+		BinField *value;
+	};
+
+	PacketBin& m_Base;
+	std::vector<CompiledPath> m_Paths;
+	std::unordered_map<std::string, uint32_t> m_PathIds;
+	std::vector<PendingPatch> m_Pending;
+
+	uint32_t CompilePath(const char* path);
+	int ApplyPatch(const PendingPatch& patch);
+};
+
+#endif //_BINPATCH_H_
\ No newline at end of file
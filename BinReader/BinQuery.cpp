@@ -0,0 +1,254 @@
+#include "BinQuery.h"
+#include <cctype>
+#include <cerrno>
+
+// Numbers are decimal unless 0x prefixed, the whole token has to be a number
+static int ParseQueryNumber(const char* string, size_t length, uint64_t& value)
+{
+	bool negative = length > 0 && string[0] == '-';
+	if (negative)
+	{
+		string++;
+		length--;
+	}
+
+	int base = 10;
+	if (length > 2 && string[0] == '0' && (string[1] == 'x' || string[1] == 'X'))
+	{
+		string += 2;
+		length -= 2;
+		base = 16;
+	}
+	if (length == 0 || !(base == 16 ? isxdigit((unsigned char)string[0]) : isdigit((unsigned char)string[0])))
+		return 0;
+
+	std::string number(string, length);
+	char* end;
+	errno = 0;
+	unsigned long long parsed = strtoull(number.c_str(), &end, base);
+	if (*end != '\0' || errno == ERANGE || (negative && parsed > (uint64_t)INT64_MAX + 1))
+		return 0;
+	value = negative ? 0 - (uint64_t)parsed : (uint64_t)parsed;
+	return 1;
+}
+
+static uint64_t ParseQueryKey(const char* string, size_t length, bool quoted)
+{
+	uint64_t value;
+	if (!quoted && ParseQueryNumber(string, length, value))
+		return value;
+	return FNV1Hash(string, length);
+}
+
+uint32_t BinQuery::AddStep(uint32_t parent, StepKind kind, uint64_t value)
+{
+	for (size_t i = 0; i < m_Nodes[parent].children.size(); i++)
+	{
+		uint32_t child = m_Nodes[parent].children[i];
+		if (m_Nodes[child].kind == kind && m_Nodes[child].value == value)
+			return child;
+	}
+
+	QueryNode node;
+	node.kind = kind;
+	node.value = value;
+	m_Nodes.emplace_back(node);
+
+	uint32_t nodeId = (uint32_t)m_Nodes.size() - 1;
+	m_Nodes[parent].children.emplace_back(nodeId);
+	return nodeId;
+}
+
+int BinQuery::AddQuery(const char* path)
+{
+	std::vector<std::pair<StepKind, uint64_t>> steps;
+
+	const char* position = path;
+	while (*position != '\0')
+	{
+		if (*position == '"')
+		{
+			const char* close = strchr(position + 1, '"');
+			if (close == nullptr)
+				return 0;
+			steps.emplace_back(StepKind::Name, FNV1Hash(position + 1, close - position - 1));
+			position = close + 1;
+		}
+		else if (*position != '[' && *position != '/')
+		{
+			size_t length = strcspn(position, "[/");
+			if (length == 1 && *position == '*')
+				steps.emplace_back(StepKind::Any, 0);
+			else if (length > 2 && position[0] == '0' && (position[1] == 'x' || position[1] == 'X'))
+			{
+				uint64_t value;
+				if (!ParseQueryNumber(position, length, value) || value > UINT32_MAX)
+					return 0;
+				steps.emplace_back(StepKind::Name, value);
+			}
+			else
+				steps.emplace_back(StepKind::Name, FNV1Hash(position, length));
+			position += length;
+		}
+		else if (*position != '[')
+			return 0;
+
+		while (*position == '[')
+		{
+			bool quoted = position[1] == '"';
+			const char* start = position + (quoted ? 2 : 1);
+			const char* close = strstr(start, quoted ? "\"]" : "]");
+			if (close == nullptr)
+				return 0;
+
+			size_t length = close - start;
+			if (!quoted && length == 1 && *start == '*')
+				steps.emplace_back(StepKind::Any, 0);
+			else
+				steps.emplace_back(StepKind::Key, ParseQueryKey(start, length, quoted));
+			position = close + (quoted ? 2 : 1);
+		}
+
+		if (*position == '/')
+		{
+			position++;
+			if (*position == '\0' || *position == '/')
+				return 0;
+		}
+		else if (*position != '\0')
+			return 0;
+	}
+
+	if (steps.empty() || steps[0].first == StepKind::Key)
+		return 0;
+
+	uint32_t nodeId = 0;
+	for (size_t i = 0; i < steps.size(); i++)
+		nodeId = AddStep(nodeId, steps[i].first, steps[i].second);
+	m_Nodes[nodeId].queries.emplace_back(m_QueryCount++);
+	return 1;
+}
+
+void BinQuery::Emit(const QueryNode& node, uint32_t entryKey, BinType type, BinData *data, BinField *field, std::vector<QueryMatch>& matches)
+{
+	for (size_t i = 0; i < node.queries.size(); i++)
+	{
+		QueryMatch match;
+		match.query = node.queries[i];
+		match.entryKey = entryKey;
+		match.type = type;
+		match.data = type == BinType::MTX44 && field != nullptr ? (BinData*)field->data.mtx : data;
+		match.field = field;
+		matches.emplace_back(match);
+	}
+}
+
+void BinQuery::Visit(uint32_t nodeId, uint32_t entryKey, BinType type, BinData *data, BinField *field, std::vector<QueryMatch>& matches)
+{
+	Emit(m_Nodes[nodeId], entryKey, type, data, field, matches);
+
+	for (size_t c = 0; c < m_Nodes[nodeId].children.size(); c++)
+	{
+		uint32_t childId = m_Nodes[nodeId].children[c];
+		StepKind kind = m_Nodes[childId].kind;
+		uint64_t value = m_Nodes[childId].value;
+
+		switch (type)
+		{
+			case BinType::POINTER:
+			case BinType::EMBEDDED:
+			{
+				PointerOrEmbed *pe = data->pe;
+				if (kind == StepKind::Any)
+				{
+					for (size_t i = 0; i < pe->items.size(); i++)
+					{
+						BinField *item = pe->items[i].value;
+						Visit(childId, entryKey, item->type, &item->data, item, matches);
+					}
+				}
+				else if (kind == StepKind::Name)
+				{
+					BinField *item = pe->FindField((uint32_t)value);
+					if (item != nullptr)
+						Visit(childId, entryKey, item->type, &item->data, item, matches);
+				}
+				break;
+			}
+			case BinType::CONTAINER:
+			case BinType::STRUCT:
+			case BinType::OPTION:
+			{
+				ContainerOrStructOrOption *cs = data->cso;
+				size_t count = GetItemCount(cs);
+				size_t first = 0, last = count;
+				if (kind == StepKind::Key)
+				{
+					if (value >= count)
+						break;
+					first = (size_t)value;
+					last = first + 1;
+				}
+				else if (kind != StepKind::Any)
+					break;
+
+				for (size_t i = first; i < last; i++)
+				{
+					if (IsPackedBinType(cs->valueType))
+					{
+						BinData *item = (BinData*)&cs->packed[i * Type_size[(uint8_t)cs->valueType]];
+						Visit(childId, entryKey, cs->valueType, item, nullptr, matches);
+					}
+					else
+						Visit(childId, entryKey, cs->items[i]->type, &cs->items[i]->data, cs->items[i], matches);
+				}
+				break;
+			}
+			case BinType::MAP:
+			{
+				Map *map = data->map;
+				if (kind == StepKind::Any)
+				{
+					for (size_t i = 0; i < map->items.size(); i++)
+					{
+						BinField *item = map->items[i].value;
+						Visit(childId, entryKey, item->type, &item->data, item, matches);
+					}
+				}
+				else
+				{
+					BinField *item = map->FindValue(value);
+					if (item != nullptr)
+						Visit(childId, entryKey, item->type, &item->data, item, matches);
+				}
+				break;
+			}
+		}
+	}
+}
+
+void BinQuery::Run(PacketBin& packet, std::vector<QueryMatch>& matches)
+{
+	Map *entriesMap = packet.m_entriesBin->data.map;
+	const QueryNode& root = m_Nodes[0];
+	for (size_t c = 0; c < root.children.size(); c++)
+	{
+		uint32_t childId = root.children[c];
+		if (m_Nodes[childId].kind == StepKind::Any)
+		{
+			for (size_t i = 0; i < entriesMap->items.size(); i++)
+			{
+				BinField *entry = packet.GetEntry(i);
+				Visit(childId, entriesMap->items[i].key->data.ui32, entry->type, &entry->data, entry, matches);
+			}
+			continue;
+		}
+
+		size_t index;
+		if (!packet.FindEntryIndex((uint32_t)m_Nodes[childId].value, index))
+			continue;
+
+		BinField *entry = packet.GetEntry(index);
+		Visit(childId, entriesMap->items[index].key->data.ui32, entry->type, &entry->data, entry, matches);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef _BINQUERY_H_
+#define _BINQUERY_H_
+
+#include "BinReader.h"
+
+// Packed container items have no BinField, data then points into the packed storage,
+// for packed types data always points at the raw value like packed items do
+struct QueryMatch
+{
+	uint32_t query = 0;
+	uint32_t entryKey = 0;
+	BinType type = BinType::NONE;
+	BinData *data = nullptr;
+	BinField *field = nullptr;
+};
+
+// Paths look like "Entry/field/map[key]/list[3]/*", entry names containing '/' are quoted,
+// all queries added are merged into one step tree and evaluated in a single walk
+class BinQuery
+{
+public:
+	BinQuery() { m_Nodes.emplace_back(); }
+
+	int AddQuery(const char* path);
+	size_t GetQueryCount() { return m_QueryCount; }
+	void Run(PacketBin& packet, std::vector<QueryMatch>& matches);
+
+private:
+	enum class StepKind : uint8_t { Root, Name, Key, Any };
+
+	struct QueryNode
+	{
+		StepKind kind = StepKind::Root;
+		uint64_t value = 0;
+		std::vector<uint32_t> children;
+		std::vector<uint32_t> queries;
+	};
+
+	std::vector<QueryNode> m_Nodes;
+	uint32_t m_QueryCount = 0;
+
+	uint32_t AddStep(uint32_t parent, StepKind kind, uint64_t value);
+	void Emit(const QueryNode& node, uint32_t entryKey, BinType type, BinData *data, BinField *field, std::vector<QueryMatch>& matches);
+	void Visit(uint32_t nodeId, uint32_t entryKey, BinType type, BinData *data, BinField *field, std::vector<QueryMatch>& matches);
+};
+
+#endif //_BINQUERY_H_
\ No newline at end of file
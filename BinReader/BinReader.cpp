@@ -1,4 +1,8 @@
 #include "BinReader.h"
+#include "BinVisitor.h"
+
+#include <unordered_set>
+#include <string_view>
 
 bool IsComplexBinType(BinType type)
 {
@@ -10,6 +14,103 @@ bool IsPointerOrEmbedded(BinType type)
 	return (type == BinType::POINTER || type == BinType::EMBEDDED);
 }
 
+bool IsPackedBinType(BinType type)
+{
+	return (type != BinType::NONE && type != BinType::STRING && !IsComplexBinType(type));
+}
+
+size_t GetItemCount(const ContainerOrStructOrOption *cs)
+{
+	if (IsPackedBinType(cs->valueType))
+		return cs->packed.size() / Type_size[(uint8_t)cs->valueType];
+	return cs->items.size();
+}
+
+BinField *CloneBinField(Arena& arena, const BinField *value, BinField *parent)
+{
+	BinField *binResult = NewBinField(arena, value->type, parent);
+	binResult->data = value->data;
+	switch (value->type)
+	{
+		case BinType::MTX44:
+		{
+			binResult->data.mtx = arena.NewArray<float>(16);
+			memcpy(binResult->data.mtx, value->data.mtx, 64);
+			break;
+		}
+		case BinType::STRING:
+		{
+			binResult->data.string = arena.NewString(value->data.string, strlen(value->data.string));
+			break;
+		}
+		case BinType::CONTAINER:
+		case BinType::STRUCT:
+		case BinType::OPTION:
+		{
+			ContainerOrStructOrOption *cs = value->data.cso;
+			ContainerOrStructOrOption *csResult = arena.New<ContainerOrStructOrOption>(arena);
+			csResult->valueType = cs->valueType;
+			csResult->packed.assign(cs->packed.begin(), cs->packed.end());
+			csResult->items.reserve(cs->items.size());
+			for (size_t i = 0; i < cs->items.size(); i++)
+				csResult->items.emplace_back(CloneBinField(arena, cs->items[i], binResult));
+			binResult->data.cso = csResult;
+			break;
+		}
+		case BinType::POINTER:
+		case BinType::EMBEDDED:
+		{
+			PointerOrEmbed *pe = value->data.pe;
+			PointerOrEmbed *peResult = arena.New<PointerOrEmbed>(arena);
+			peResult->name = pe->name;
+			peResult->items.reserve(pe->items.size());
+			for (size_t i = 0; i < pe->items.size(); i++)
+			{
+				EPField field;
+				field.key = pe->items[i].key;
+				field.value = CloneBinField(arena, pe->items[i].value, binResult);
+				peResult->items.emplace_back(field);
+			}
+			binResult->data.pe = peResult;
+			break;
+		}
+		case BinType::MAP:
+		{
+			Map *map = value->data.map;
+			Map *mapResult = arena.New<Map>(arena);
+			mapResult->keyType = map->keyType;
+			mapResult->valueType = map->valueType;
+			mapResult->items.reserve(map->items.size());
+			for (size_t i = 0; i < map->items.size(); i++)
+			{
+				MapPair pair;
+				pair.key = CloneBinField(arena, map->items[i].key, binResult);
+				pair.value = CloneBinField(arena, map->items[i].value, binResult);
+				mapResult->items.emplace_back(pair);
+			}
+			binResult->data.map = mapResult;
+			break;
+		}
+	}
+	return binResult;
+}
+
+BinField *MakeWritable(Arena& arena, BinField *&value, BinField *parent)
+{
+	if (value->shared)
+		value = CloneBinField(arena, value, parent);
+	return value;
+}
+
+void AppendPackedItem(ContainerOrStructOrOption *cs, const BinField *item)
+{
+	size_t size = Type_size[(uint8_t)cs->valueType];
+	const uint8_t *data = (const uint8_t*)&item->data;
+	if (item->type == BinType::MTX44)
+		data = (const uint8_t*)item->data.mtx;
+	cs->packed.insert(cs->packed.end(), data, data + size);
+}
+
 BinType Uint8ToType(uint8_t type)
 {
 	if (type & 0x80)
@@ -18,6 +119,133 @@ BinType Uint8ToType(uint8_t type)
 	return (BinType)type;
 }
 
+uint64_t GetMapKeyValue(const BinField *key)
+{
+	switch (key->type)
+	{
+		case BinType::SInt8:
+			return (uint64_t)(int64_t)(int8_t)key->data.ui64;
+		case BinType::SInt16:
+			return (uint64_t)(int64_t)(int16_t)key->data.ui64;
+		case BinType::SInt32:
+			return (uint64_t)(int64_t)(int32_t)key->data.ui64;
+		case BinType::STRING:
+			return FNV1Hash(key->data.string, strlen(key->data.string));
+	}
+	return key->data.ui64;
+}
+
+static uint32_t GetIndexSlot(uint64_t key, size_t mask)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (uint32_t)(key & mask);
+}
+
+template<typename GetKey>
+static void BuildIndex(ArenaVector<uint32_t>& index, size_t count, GetKey getKey)
+{
+	size_t capacity = 16;
+	while (capacity < count * 2)
+		capacity *= 2;
+	index.assign(capacity, 0);
+
+	size_t mask = capacity - 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t key = getKey(i);
+		uint32_t slot = GetIndexSlot(key, mask);
+		while (index[slot] != 0 && getKey(index[slot] - 1) != key)
+			slot = (slot + 1) & mask;
+		if (index[slot] == 0)
+			index[slot] = (uint32_t)i + 1;
+	}
+}
+
+template<typename GetKey>
+static size_t FindInIndex(const ArenaVector<uint32_t>& index, uint64_t key, GetKey getKey)
+{
+	size_t mask = index.size() - 1;
+	uint32_t slot = GetIndexSlot(key, mask);
+	while (index[slot] != 0)
+	{
+		if (getKey(index[slot] - 1) == key)
+			return index[slot] - 1;
+		slot = (slot + 1) & mask;
+	}
+	return SIZE_MAX;
+}
+
+void PointerOrEmbed::UpdateIndex()
+{
+	if (items.size() < IndexThreshold)
+		return;
+	BuildIndex(index, items.size(), [this](size_t i) { return (uint64_t)items[i].key; });
+	indexedCount = items.size();
+}
+
+size_t PointerOrEmbed::FindItem(uint32_t key)
+{
+	if (items.size() < IndexThreshold)
+	{
+		for (size_t i = 0; i < items.size(); i++)
+			if (items[i].key == key)
+				return i;
+		return SIZE_MAX;
+	}
+
+	if (index.empty() || indexedCount != items.size())
+		UpdateIndex();
+	return FindInIndex(index, key, [this](size_t i) { return (uint64_t)items[i].key; });
+}
+
+BinField *PointerOrEmbed::FindField(uint32_t key)
+{
+	size_t found = FindItem(key);
+	return found != SIZE_MAX ? items[found].value : nullptr;
+}
+
+void Map::UpdateIndex()
+{
+	if (items.size() < IndexThreshold)
+		return;
+	BuildIndex(index, items.size(), [this](size_t i) { return GetMapKeyValue(items[i].key); });
+	indexedCount = items.size();
+}
+
+size_t Map::FindItem(uint64_t key)
+{
+	if (items.size() < IndexThreshold)
+	{
+		for (size_t i = 0; i < items.size(); i++)
+			if (GetMapKeyValue(items[i].key) == key)
+				return i;
+		return SIZE_MAX;
+	}
+
+	if (index.empty() || indexedCount != items.size())
+		UpdateIndex();
+	return FindInIndex(index, key, [this](size_t i) { return GetMapKeyValue(items[i].key); });
+}
+
+BinField *Map::FindValue(uint64_t key)
+{
+	size_t found = FindItem(key);
+	return found != SIZE_MAX ? items[found].value : nullptr;
+}
+
+BinField *Map::FindValue(const char* key)
+{
+	if (keyType != BinType::STRING)
+		return nullptr;
+
+	size_t found = FindItem(FNV1Hash(key, strlen(key)));
+	if (found == SIZE_MAX || strcmp(items[found].key->data.string, key) != 0)
+		return nullptr;
+	return items[found].value;
+}
+
 uint8_t TypeToUint8(BinType type)
 {
 	uint8_t raw = (uint8_t)type;
@@ -34,11 +262,52 @@ BinType FindTypeByString(const char* string)
 	return BinType::NONE;
 }
 
-BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField *parent, CharMemVector& input)
+BinField *NewBinField(Arena& arena, BinType type, BinField *parent)
 {
-	BinField *binResult = new BinField;
-	binResult->type = Uint8ToType(type);
-	binResult->parent = parent;
+	BinField *binField = arena.New<BinField>();
+	binField->type = type;
+	binField->parent = parent;
+	return binField;
+}
+
+BinField *ReadValueByBinFieldType(const uint8_t type, Arena& arena, BinField *parent, CharMemView& input, DedupContext *dedup);
+
+static size_t GetDedupSpanSize(BinType type, CharMemView& input)
+{
+	size_t sizeOffset;
+	switch (type)
+	{
+		case BinType::CONTAINER:
+		case BinType::STRUCT:
+			sizeOffset = 1;
+			break;
+		case BinType::POINTER:
+		case BinType::EMBEDDED:
+			sizeOffset = 4;
+			break;
+		case BinType::MAP:
+			sizeOffset = 2;
+			break;
+		default:
+			return 0;
+	}
+
+	if (input.m_Size - input.m_Pointer < sizeOffset + 4)
+		return 0;
+
+	const uint8_t *header = input.m_Array + input.m_Pointer;
+	uint32_t name, size;
+	memcpy(&name, header, 4);
+	memcpy(&size, header + sizeOffset, 4);
+	if (IsPointerOrEmbedded(type) && name == 0)
+		return 0;
+	return sizeOffset + 4 + size;
+}
+
+static BinField *ReadBinField(const uint8_t type, Arena& arena, BinField *parent, CharMemView& input, DedupContext *dedup)
+{
+	BinField *binResult = NewBinField(arena, Uint8ToType(type), parent);
+	binResult->shared = dedup != nullptr && &arena == dedup->arena;
 	switch (binResult->type)
 	{
 		case BinType::SInt8:
@@ -53,41 +322,43 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 		case BinType::LINK:
 		case BinType::WADENTRYLINK:
 		{
-			input.MemRead(&binResult->data->ui64, Type_size[(uint8_t)binResult->type]);
+			input.MemRead(&binResult->data.ui64, Type_size[(uint8_t)binResult->type]);
 			break;
 		}
 		case BinType::BOOLB:
 		case BinType::FLAG:
 		{
-			input.MemRead(&binResult->data->b, Type_size[(uint8_t)binResult->type]);
+			input.MemRead(&binResult->data.b, Type_size[(uint8_t)binResult->type]);
 			break;
 		}		
 		case BinType::Float32:
+		{
+			binResult->data.f32 = input.MemRead<float>();
+			break;
+		}
 		case BinType::VEC2:
 		case BinType::VEC3:
 		case BinType::VEC4:
-		case BinType::MTX44:
+		case BinType::RGBA:
 		{
-			binResult->data->floatv = (float*)input.MemRead(Type_size[(uint8_t)binResult->type]);
+			input.MemRead(binResult->data.vec, Type_size[(uint8_t)binResult->type]);
 			break;
 		}
-		case BinType::RGBA:
+		case BinType::MTX44:
 		{
-			binResult->data->rgba = (uint8_t*)input.MemRead(Type_size[(uint8_t)binResult->type]);
+			binResult->data.mtx = arena.NewArray<float>(16);
+			input.MemRead(binResult->data.mtx, 64);
 			break;
 		}
 		case BinType::STRING:
 		{
 			size_t stringLength = input.MemRead<uint16_t>();
 
-			char* string = new char[stringLength + 1];
+			char* string = arena.NewArray<char>(stringLength + 1);
 			input.MemRead(string, stringLength);
 			string[stringLength] = '\0';
 
-			hashT.Insert(FNV1Hash(string, stringLength), string);
-			hashT.Insert(XXHash(string, stringLength), string);
-
-			binResult->data->string = string;
+			binResult->data.string = string;
 			break;
 		}
 		case BinType::CONTAINER:
@@ -97,26 +368,34 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 			uint32_t size = input.MemRead<uint32_t>();
 			uint32_t fieldCount = input.MemRead<uint32_t>();
 
-			ContainerOrStructOrOption *cs = new ContainerOrStructOrOption;
+			ContainerOrStructOrOption *cs = arena.New<ContainerOrStructOrOption>(arena);
 			cs->valueType = Uint8ToType(type);
-			cs->items.reserve(fieldCount);
+			binResult->data.cso = cs;
 
+			if (IsPackedBinType(cs->valueType))
+			{
+				size_t packedSize = fieldCount * Type_size[(uint8_t)cs->valueType];
+				const uint8_t *packed = input.MemSkip(packedSize);
+				cs->packed.insert(cs->packed.end(), packed, packed + packedSize);
+				break;
+			}
+
+			cs->items.reserve(fieldCount);
 			for (uint32_t i = 0; i < fieldCount; i++)
 			{
-				BinField* field = ReadValueByBinFieldType(type, hashT, binResult, input);
+				BinField* field = ReadValueByBinFieldType(type, arena, binResult, input, dedup);
 				cs->items.emplace_back(field);
 			}
-			binResult->data->cso = cs;
 			break;
 		}
 		case BinType::POINTER:
 		case BinType::EMBEDDED:
 		{
-			PointerOrEmbed *pe = new PointerOrEmbed;
+			PointerOrEmbed *pe = arena.New<PointerOrEmbed>(arena);
 			input.MemRead(&pe->name, 4);
 			if (pe->name == 0)
 			{
-				binResult->data->pe = pe;
+				binResult->data.pe = pe;
 				break;
 			}
 
@@ -131,10 +410,12 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 				input.MemRead(&field.key, 4);
 				uint8_t type = input.MemRead<uint8_t>();
 
-				field.value = ReadValueByBinFieldType(type, hashT, binResult, input);
+				field.value = ReadValueByBinFieldType(type, arena, binResult, input, dedup);
 				pe->items.emplace_back(field);
 			}
-			binResult->data->pe = pe;
+			if (binResult->shared)
+				pe->UpdateIndex();
+			binResult->data.pe = pe;
 			break;
 		}
 		case BinType::OPTION:
@@ -142,16 +423,24 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 			uint8_t type = input.MemRead<uint8_t>();
 			uint8_t fieldCount = input.MemRead<uint8_t>();
 
-			ContainerOrStructOrOption *option = new ContainerOrStructOrOption;
+			ContainerOrStructOrOption *option = arena.New<ContainerOrStructOrOption>(arena);
 			option->valueType = Uint8ToType(type);
-			option->items.reserve(fieldCount);
+			binResult->data.cso = option;
 
+			if (IsPackedBinType(option->valueType))
+			{
+				size_t packedSize = fieldCount * Type_size[(uint8_t)option->valueType];
+				const uint8_t *packed = input.MemSkip(packedSize);
+				option->packed.insert(option->packed.end(), packed, packed + packedSize);
+				break;
+			}
+
+			option->items.reserve(fieldCount);
 			for (uint32_t i = 0; i < fieldCount; i++)
 			{
-				BinField* field = ReadValueByBinFieldType(type, hashT, binResult, input);
+				BinField* field = ReadValueByBinFieldType(type, arena, binResult, input, dedup);
 				option->items.emplace_back(field);
 			}
-			binResult->data->cso = option;
 			break;
 		}
 		case BinType::MAP:
@@ -161,7 +450,7 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 			uint32_t size = input.MemRead<uint32_t>();
 			uint32_t fieldCount = input.MemRead<uint32_t>();
 
-			Map *map = new Map;
+			Map *map = arena.New<Map>(arena);
 			map->keyType = Uint8ToType(keyType);
 			map->valueType = Uint8ToType(valueType);
 			map->items.reserve(fieldCount);
@@ -169,30 +458,57 @@ BinField *ReadValueByBinFieldType(const uint8_t type, HashTable& hashT, BinField
 			for (uint32_t i = 0; i < fieldCount; i++)
 			{
 				MapPair pair;
-				pair.key = ReadValueByBinFieldType(keyType, hashT, binResult, input);
-				pair.value = ReadValueByBinFieldType(valueType, hashT, binResult, input);
+				pair.key = ReadValueByBinFieldType(keyType, arena, binResult, input, dedup);
+				pair.value = ReadValueByBinFieldType(valueType, arena, binResult, input, dedup);
 				map->items.emplace_back(pair);
 			}
-			binResult->data->map = map;
+			if (binResult->shared)
+				map->UpdateIndex();
+			binResult->data.map = map;
 			break;
 		}
 	}
 	return binResult;
 }
 
+BinField *ReadValueByBinFieldType(const uint8_t type, Arena& arena, BinField *parent, CharMemView& input, DedupContext *dedup)
+{
+	if (dedup == nullptr)
+		return ReadBinField(type, arena, parent, input, nullptr);
+
+	size_t spanSize = GetDedupSpanSize(Uint8ToType(type), input);
+	if (spanSize < DedupPool::MinSpanSize || spanSize > input.m_Size - input.m_Pointer)
+		return ReadBinField(type, arena, parent, input, dedup);
+
+	const uint8_t *span = input.m_Array + input.m_Pointer;
+	uint64_t hash = XXHash((const char*)span, spanSize);
+
+	BinField *shared = dedup->pool->Find(type, hash, span, spanSize);
+	if (shared != nullptr)
+	{
+		input.m_Pointer += spanSize;
+		return shared;
+	}
+
+	shared = ReadBinField(type, *dedup->arena, nullptr, input, dedup);
+	dedup->pool->Insert(type, hash, spanSize, shared);
+	return shared;
+}
+
 uint32_t GetTotalBinFieldSize(BinField *value)
 {
 	uint32_t size = (uint32_t)Type_size[(uint8_t)value->type];
 	switch (value->type)
 	{
 		case BinType::STRING:
-			size = 2 + (uint32_t)strlen(value->data->string);
+			size = 2 + (uint32_t)strlen(value->data.string);
 			break;
 		case BinType::STRUCT:
 		case BinType::CONTAINER:
 		{
 			size = 1 + 4 + 4;
-			ContainerOrStructOrOption *cs = value->data->cso;
+			ContainerOrStructOrOption *cs = value->data.cso;
+			size += (uint32_t)cs->packed.size();
 			for (uint32_t i = 0; i < cs->items.size(); i++)
 				size += GetTotalBinFieldSize(cs->items[i]);
 			break;
@@ -201,7 +517,7 @@ uint32_t GetTotalBinFieldSize(BinField *value)
 		case BinType::EMBEDDED:
 		{
 			size = 4;
-			PointerOrEmbed *pe = value->data->pe;
+			PointerOrEmbed *pe = value->data.pe;
 			if (pe->name != 0)
 			{
 				size += 4 + 2;
@@ -213,7 +529,8 @@ uint32_t GetTotalBinFieldSize(BinField *value)
 		case BinType::OPTION:
 		{
 			size = 2;
-			ContainerOrStructOrOption *option = value->data->cso;
+			ContainerOrStructOrOption *option = value->data.cso;
+			size += (uint32_t)option->packed.size();
 			for (uint8_t i = 0; i < option->items.size(); i++)
 				size += GetTotalBinFieldSize(option->items[i]);
 			break;
@@ -221,7 +538,7 @@ uint32_t GetTotalBinFieldSize(BinField *value)
 		case BinType::MAP:
 		{
 			size = 1 + 1 + 4 + 4;
-			Map *map = value->data->map;
+			Map *map = value->data.map;
 			for (uint32_t i = 0; i < map->items.size(); i++)
 				size += GetTotalBinFieldSize(map->items[i].key) +
 						GetTotalBinFieldSize(map->items[i].value);
@@ -231,6 +548,83 @@ uint32_t GetTotalBinFieldSize(BinField *value)
 	return size;
 }
 
+size_t GetThreadCount(size_t itemsCount)
+{
+	size_t threadCount = std::thread::hardware_concurrency();
+	if (threadCount > itemsCount / 64)
+		threadCount = itemsCount / 64;
+	return threadCount;
+}
+
+void CharMemVector::MemWriteSlow(void *value, size_t size)
+{
+	if (m_Stream != nullptr)
+	{
+		myassert(Flush() == 0)
+		if (size >= m_Capacity)
+		{
+			myassert(fwrite(value, 1, size, m_Stream) != size)
+			m_Flushed += size;
+			return;
+		}
+	}
+	else
+		MemGrow(size);
+
+	memcpy(m_Array + m_Size, value, size);
+	m_Size += size;
+}
+
+void CharMemVector::MemGrow(size_t size)
+{
+	myassert(!m_Owned)
+
+	if (m_Stream != nullptr)
+	{
+		myassert(Flush() == 0)
+		if (size <= m_Capacity)
+			return;
+	}
+
+	size_t capacity = m_Capacity * 2;
+	if (capacity < m_Size + size)
+		capacity = m_Size + size;
+	if (capacity < 4096)
+		capacity = 4096;
+
+	m_Array = (uint8_t*)realloc(m_Array, capacity);
+	myassert(m_Array == nullptr)
+	m_Capacity = capacity;
+}
+
+static int SeekStream(FILE *stream, size_t offset, int origin)
+{
+#ifdef _WIN32
+	return _fseeki64(stream, (int64_t)offset, origin);
+#else
+	return fseeko(stream, (off_t)offset, origin);
+#endif
+}
+
+void CharMemVector::MemPatchStream(size_t offset, void *value, size_t size)
+{
+	myassert(m_Stream == nullptr)
+	myassert(SeekStream(m_Stream, offset, SEEK_SET) != 0)
+	myassert(fwrite(value, 1, size, m_Stream) != size)
+	myassert(SeekStream(m_Stream, 0, SEEK_END) != 0)
+}
+
+int CharMemVector::Flush()
+{
+	if (m_Stream == nullptr || m_Size == 0)
+		return 1;
+	if (fwrite(m_Array, 1, m_Size, m_Stream) != m_Size)
+		return 0;
+	m_Flushed += m_Size;
+	m_Size = 0;
+	return 1;
+}
+
 void WriteValueByBinField(BinField *value, CharMemVector& output)
 {
 	switch (value->type)
@@ -248,35 +642,38 @@ void WriteValueByBinField(BinField *value, CharMemVector& output)
 		case BinType::WADENTRYLINK:
 		{
 			size_t size = Type_size[(uint8_t)value->type];
-			output.MemWrite(&value->data->ui64, size);
+			output.MemWrite(&value->data.ui64, size);
 			break;
 		}
 		case BinType::BOOLB:
 		case BinType::FLAG:
 		{
 			size_t size = Type_size[(uint8_t)value->type];
-			output.MemWrite(&value->data->b, size);
+			output.MemWrite(&value->data.b, size);
 			break;
 		}
 		case BinType::Float32:
+		{
+			output.MemWrite(value->data.f32);
+			break;
+		}
 		case BinType::VEC2:
 		case BinType::VEC3:
 		case BinType::VEC4:
-		case BinType::MTX44: 
+		case BinType::RGBA:
 		{
 			size_t size = Type_size[(uint8_t)value->type];
-			output.MemWrite(value->data->floatv, size);
+			output.MemWrite(value->data.vec, size);
 			break;
 		}
-		case BinType::RGBA:
+		case BinType::MTX44: 
 		{
-			size_t size = Type_size[(uint8_t)value->type];
-			output.MemWrite(value->data->rgba, size);
+			output.MemWrite(value->data.mtx, 64);
 			break;
 		}
 		case BinType::STRING:
 		{
-			char* string = value->data->string;
+			char* string = value->data.string;
 			uint16_t stringLen = (uint16_t)strlen(string);
 
 			output.MemWrite(stringLen);
@@ -286,37 +683,34 @@ void WriteValueByBinField(BinField *value, CharMemVector& output)
 		case BinType::STRUCT:
 		case BinType::CONTAINER:
 		{
-			ContainerOrStructOrOption *cs = value->data->cso;
-			uint32_t size = 4, fieldCount = (uint32_t)cs->items.size();
+			ContainerOrStructOrOption *cs = value->data.cso;
+			uint32_t fieldCount = (uint32_t)GetItemCount(cs);
 
 			uint8_t type = TypeToUint8(cs->valueType);
 
-			for (uint32_t i = 0; i < fieldCount; i++)
-				size += GetTotalBinFieldSize(cs->items[i]);
-
 			output.MemWrite(type);
-			output.MemWrite(size);
+			size_t sizeOffset = output.MemReserve(4);
 			output.MemWrite(fieldCount);
 
-			for (uint32_t i = 0; i < fieldCount; i++)
+			if (cs->packed.size() > 0)
+				output.MemWrite(cs->packed.data(), cs->packed.size());
+			for (uint32_t i = 0; i < cs->items.size(); i++)
 				WriteValueByBinField(cs->items[i], output);
+
+			output.MemPatch(sizeOffset, (uint32_t)(output.MemSize() - sizeOffset - 4));
 			break;
 		}
 		case BinType::POINTER:
 		case BinType::EMBEDDED:
 		{
-			PointerOrEmbed *pe = value->data->pe;
+			PointerOrEmbed *pe = value->data.pe;
 			output.MemWrite(pe->name);
 			if (pe->name == 0)
 				break;
 
-			uint32_t size = 2;
 			uint16_t fieldCount = (uint16_t)pe->items.size();
 
-			for (uint16_t i = 0; i < fieldCount; i++)
-				size += GetTotalBinFieldSize(pe->items[i].value) + 4 + 1;
-
-			output.MemWrite(size);
+			size_t sizeOffset = output.MemReserve(4);
 			output.MemWrite(fieldCount);
 
 			for (uint16_t i = 0; i < fieldCount; i++)
@@ -326,36 +720,36 @@ void WriteValueByBinField(BinField *value, CharMemVector& output)
 				output.MemWrite(type);
 				WriteValueByBinField(pe->items[i].value, output);
 			}
+
+			output.MemPatch(sizeOffset, (uint32_t)(output.MemSize() - sizeOffset - 4));
 			break;
 		}
 		case BinType::OPTION:
 		{
-			ContainerOrStructOrOption *op = value->data->cso;
-			uint8_t fieldCount = (uint8_t)op->items.size();
+			ContainerOrStructOrOption *op = value->data.cso;
+			uint8_t fieldCount = (uint8_t)GetItemCount(op);
 
 			uint8_t type = TypeToUint8(op->valueType);
 			output.MemWrite(type);
 			output.MemWrite(fieldCount);
 
-			for (uint8_t i = 0; i < fieldCount; i++)
+			if (op->packed.size() > 0)
+				output.MemWrite(op->packed.data(), op->packed.size());
+			for (uint8_t i = 0; i < op->items.size(); i++)
 				WriteValueByBinField(op->items[i], output);
 			break;
 		}
 		case BinType::MAP:
 		{
-			Map *map = value->data->map;
-			uint32_t size = 4, fieldCount = (uint32_t)map->items.size();
-
-			for (uint32_t i = 0; i < fieldCount; i++)
-				size += GetTotalBinFieldSize(map->items[i].key) + 
-						GetTotalBinFieldSize(map->items[i].value);
+			Map *map = value->data.map;
+			uint32_t fieldCount = (uint32_t)map->items.size();
 
 			uint8_t typeKey = TypeToUint8(map->keyType);
 			uint8_t typeValue = TypeToUint8(map->valueType);
 			output.MemWrite(typeKey);
 			output.MemWrite(typeValue);
 
-			output.MemWrite(size);
+			size_t sizeOffset = output.MemReserve(4);
 			output.MemWrite(fieldCount);
 
 			for (uint32_t i = 0; i < fieldCount; i++)
@@ -363,36 +757,313 @@ void WriteValueByBinField(BinField *value, CharMemVector& output)
 				WriteValueByBinField(map->items[i].key, output);
 				WriteValueByBinField(map->items[i].value, output);
 			}
+
+			output.MemPatch(sizeOffset, (uint32_t)(output.MemSize() - sizeOffset - 4));
 			break;
 		}
 	}
 }
 
-int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
+bool MatchesBinFieldBytes(BinField *value, const uint8_t* data, size_t size)
+{
+	thread_local CharMemVector scratch;
+	scratch.m_Size = 0;
+	WriteValueByBinField(value, scratch);
+	return scratch.m_Size == size && memcmp(scratch.m_Array, data, size) == 0;
+}
+
+void PacketBin::LoadEntry(size_t spanIndex, Arena& arena, Arena *poolArena)
 {
+	DedupContext dedup;
+	dedup.pool = m_DedupPool;
+	dedup.arena = poolArena;
+
+	EntrySpan& span = m_entrySpans[spanIndex];
+	BinField *entryValue = span.value;
+
+	CharMemView input(m_File.m_Data + span.offset, span.length);
+	input.m_Pointer = 4;
+
+	uint16_t fieldCount = input.MemRead<uint16_t>();
+
+	PointerOrEmbed *embed = arena.New<PointerOrEmbed>(arena);
+	embed->name = span.classHash;
+	embed->items.reserve(fieldCount);
+	for (uint16_t o = 0; o < fieldCount; o++)
+	{
+		uint32_t name = input.MemRead<uint32_t>();
+		uint8_t type = input.MemRead<uint8_t>();
+
+		EPField field;
+		field.key = name;
+		field.value = ReadValueByBinFieldType(type, arena, entryValue, input, m_DedupPool != nullptr ? &dedup : nullptr);
+		embed->items.emplace_back(field);
+	}
+
+	entryValue->data.pe = embed;
+	span.loaded = true;
+}
+
+size_t PacketBin::FindEntrySpan(size_t index)
+{
+	BinField *value = m_entriesBin->data.map->items[index].value;
+	if (index < m_entrySpans.size() && m_entrySpans[index].value == value)
+		return index;
+
+	std::call_once(m_spanIndexOnce, [this]()
+	{
+		m_spanIndex.reserve(m_entrySpans.size());
+		for (size_t i = 0; i < m_entrySpans.size(); i++)
+			m_spanIndex.emplace(m_entrySpans[i].keyHash, i);
+	});
+
+	auto range = m_spanIndex.equal_range(m_entriesBin->data.map->items[index].key->data.ui32);
+	for (auto it = range.first; it != range.second; ++it)
+		if (m_entrySpans[it->second].value == value)
+			return it->second;
+	return SIZE_MAX;
+}
+
+BinField *PacketBin::GetEntry(size_t index)
+{
+	size_t spanIndex = FindEntrySpan(index);
+	if (spanIndex != SIZE_MAX && !m_entrySpans[spanIndex].loaded)
+		LoadEntry(spanIndex, m_Arena, GetPoolArena());
+	return m_entriesBin->data.map->items[index].value;
+}
+
+void PacketBin::LoadAllEntries()
+{
+	size_t entriesCount = m_entrySpans.size();
+	size_t threadCount = GetThreadCount(entriesCount);
+	if (m_MaxThreads != 0 && threadCount > m_MaxThreads)
+		threadCount = m_MaxThreads;
+	if (threadCount <= 1)
+	{
+		for (size_t i = 0; i < entriesCount; i++)
+			if (!m_entrySpans[i].loaded)
+				LoadEntry(i, m_Arena, GetPoolArena());
+		return;
+	}
+
+	size_t arenaFirst = m_workerArenas.size();
+	for (size_t t = 0; t < threadCount; t++)
+		m_workerArenas.emplace_back(new Arena);
+
+	RunThreads(threadCount, entriesCount, [&](size_t t, size_t first, size_t last)
+	{
+		Arena& arena = *m_workerArenas[arenaFirst + t];
+		Arena *poolArena = m_DedupPool != nullptr ? m_DedupPool->AcquireArena() : nullptr;
+		for (size_t i = first; i < last; i++)
+			if (!m_entrySpans[i].loaded)
+				LoadEntry(i, arena, poolArena);
+		if (poolArena != nullptr)
+			m_DedupPool->ReleaseArena(poolArena);
+	});
+}
+
+class StringHarvester : public BinVisitor
+{
+public:
+	std::vector<std::string_view> strings;
+	std::unordered_set<std::string_view> seen;
+
+	void Value(BinType type, const uint8_t* data, size_t size) override
+	{
+		if (type != BinType::STRING)
+			return;
+
+		std::string_view string((const char*)data, size);
+		if (seen.insert(string).second)
+			strings.emplace_back(string);
+	}
+};
+
+void PacketBin::HarvestStrings(HashTable& hashT)
+{
+	if (m_File.m_Data == nullptr)
+		return;
+
+	StringHarvester harvester;
+	VisitBin(m_File.m_Data, m_File.m_Size, harvester);
+
+	size_t stringCount = harvester.strings.size();
+	std::vector<uint32_t> fnvHashes(stringCount);
+	std::vector<uint64_t> xxHashes(stringCount);
+	for (size_t i = 0; i < stringCount; i++)
+	{
+		std::string_view string = harvester.strings[i];
+		fnvHashes[i] = FNV1Hash(string.data(), string.size());
+		xxHashes[i] = XXHash(string.data(), string.size());
+	}
+
+	hashT.Reserve(stringCount * 2);
+	for (size_t i = 0; i < stringCount; i++)
+	{
+		hashT.Insert(fnvHashes[i], harvester.strings[i]);
+		hashT.Insert(xxHashes[i], harvester.strings[i]);
+	}
+}
+
+Arena *PacketBin::GetPoolArena()
+{
+	if (m_DedupPool != nullptr && m_PoolArena == nullptr)
+		m_PoolArena = m_DedupPool->AcquireArena();
+	return m_PoolArena;
+}
+
+BinField *PacketBin::EditEntry(size_t index)
+{
+	BinField *entry = GetEntry(index);
+	MarkEntryDirty(index);
+	return entry;
+}
+
+void PacketBin::MarkEntryDirty(size_t index)
+{
+	size_t spanIndex = FindEntrySpan(index);
+	if (spanIndex == SIZE_MAX)
+		return;
+	if (!m_entrySpans[spanIndex].loaded)
+		LoadEntry(spanIndex, m_Arena, GetPoolArena());
+	m_entrySpans[spanIndex].dirty = true;
+}
+
+int PacketBin::FindEntryIndex(uint32_t keyHash, size_t& index)
+{
+	Map *entriesMap = m_entriesBin->data.map;
+	if (m_entryIndex.size() != entriesMap->items.size())
+	{
+		m_entryIndex.clear();
+		m_entryIndex.reserve(entriesMap->items.size());
+		for (size_t i = 0; i < entriesMap->items.size(); i++)
+			m_entryIndex.emplace(entriesMap->items[i].key->data.ui32, i);
+	}
+
+	auto found = m_entryIndex.find(keyHash);
+	if (found == m_entryIndex.end())
+		return 0;
+	index = found->second;
+	return 1;
+}
+
+BinField *PacketBin::FindEntry(uint32_t keyHash)
+{
+	size_t index;
+	if (!FindEntryIndex(keyHash, index))
+		return nullptr;
+	return GetEntry(index);
+}
+
+int PacketBin::SaveEntryIndex(const char* indexPath)
+{
+	CharMemVector output;
+	output.MemWrite((void*)"BIDX", 4);
+	output.MemWrite(EntryIndexVersion);
+	output.MemWrite((uint64_t)m_File.m_Size);
+	output.MemWrite(XXHash((const char*)m_File.m_Data, m_entriesStart));
+	output.MemWrite((uint64_t)m_entriesEnd);
+
+	uint32_t entriesCount = (uint32_t)m_entrySpans.size();
+	output.MemWrite(entriesCount);
+
+	for (uint32_t i = 0; i < entriesCount; i++)
+	{
+		output.MemWrite(m_entrySpans[i].keyHash);
+		output.MemWrite(m_entrySpans[i].classHash);
+		output.MemWrite(m_entrySpans[i].length);
+		output.MemWrite((uint64_t)m_entrySpans[i].offset);
+	}
+
 	FILE *file;
-	errno_t err = fopen_s(&file, filePath, "rb");
+	errno_t err = fopen_s(&file, indexPath, "wb");
 	if (err)
 	{
-		char errMsg[255] = { "\0" };
-		strerror_s(errMsg, 255, errno);
-		printf("ERROR: Cannot read file %s %s\n", filePath, errMsg);
+		char errMsg[255] = { '\0' };
+		strerror_s(errMsg, 255, err);
+		printf("ERROR: Cannot write file %s %s\n", indexPath, errMsg);
 		return 0;
 	}
 
-	printf("Reading file: %s\n", filePath);
-	fseek(file, 0, SEEK_END);
-	size_t fsize = (size_t)ftell(file);
-	fseek(file, 0, SEEK_SET);
-	std::string fp(fsize + 1, '\0');
-	myassert(fread(fp.data(), 1, fsize, file) != fsize)
+	myassert(fwrite(output.m_Array, 1, output.m_Size, file) != output.m_Size)
 	fclose(file);
-	printf("Finised reading file\n");
+	return 1;
+}
+
+int PacketBin::LoadEntryIndex(const char* indexPath, size_t entriesCount)
+{
+	MappedFile file;
+	if (!file.Open(indexPath))
+		return 0;
+
+	const size_t headerSize = 4 + 4 + 8 + 8 + 8 + 4;
+	const size_t spanSize = 4 + 4 + 4 + 8;
+	if (file.m_Size < headerSize || memcmp(file.m_Data, "BIDX", 4) != 0)
+	{
+		printf("Index %s has no valid signature\n", indexPath);
+		return 0;
+	}
+
+	CharMemView input(file.m_Data, file.m_Size);
+	input.m_Pointer = 4;
+
+	uint32_t version = input.MemRead<uint32_t>();
+	uint64_t fileSize = input.MemRead<uint64_t>();
+	uint64_t headerHash = input.MemRead<uint64_t>();
+	uint64_t entriesEnd = input.MemRead<uint64_t>();
+	uint32_t indexCount = input.MemRead<uint32_t>();
+	if (version != EntryIndexVersion || fileSize != m_File.m_Size || entriesEnd > fileSize ||
+		indexCount != entriesCount || file.m_Size != headerSize + indexCount * spanSize ||
+		headerHash != XXHash((const char*)m_File.m_Data, m_entriesStart))
+	{
+		printf("Index %s does not match bin, ignoring it\n", indexPath);
+		return 0;
+	}
+
+	// The header hash covers the class table, each span is checked against its length and key in the bin
+	m_entrySpans.resize(indexCount);
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		EntrySpan& span = m_entrySpans[i];
+		span.keyHash = input.MemRead<uint32_t>();
+		span.classHash = input.MemRead<uint32_t>();
+		span.length = input.MemRead<uint32_t>();
+		span.offset = (size_t)input.MemRead<uint64_t>();
+
+		uint32_t length, keyHash;
+		bool valid = span.length >= 4 + 2 && span.offset >= m_entriesStart + 4 && span.offset <= entriesEnd &&
+			span.length <= entriesEnd - span.offset;
+		if (valid)
+		{
+			memcpy(&length, m_File.m_Data + span.offset - 4, 4);
+			memcpy(&keyHash, m_File.m_Data + span.offset, 4);
+			valid = length == span.length && keyHash == span.keyHash;
+		}
+		if (!valid)
+		{
+			printf("Index %s does not match bin, ignoring it\n", indexPath);
+			m_entrySpans.clear();
+			return 0;
+		}
+	}
+	m_entriesEnd = (size_t)entriesEnd;
+	return 1;
+}
+
+int PacketBin::DecodeBin(char* filePath, bool lazy, const char* indexPath)
+{
+	if (!m_File.Open(filePath))
+		return 0;
+
+	if (m_Verbose)
+	{
+		printf("Reading file: %s\n", filePath);
+		printf("Finised reading file\n");
 
-	printf("Reading bin from file\n");
+		printf("Reading bin from file\n");
+	}
 
-	CharMemVector input;
-	input.MemWrite(fp.data(), fsize);
+	CharMemView input(m_File.m_Data, m_File.m_Size);
 
 	uint32_t signature = input.MemRead<uint32_t>();
 	if (memcmp(&signature, "PTCH", 4) == 0)
@@ -419,7 +1090,7 @@ int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
 			{
 				size_t stringLength = (size_t)input.MemRead<uint16_t>();
 
-				std::string linkedStr(stringLength + 1, '\0');
+				std::string linkedStr(stringLength, '\0');
 				input.MemRead(linkedStr.data(), stringLength);
 
 				m_linkedList.emplace_back(linkedStr);
@@ -427,65 +1098,68 @@ int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
 		}
 	}
 
-	Map *entriesMap = new Map;
+	Map *entriesMap = m_Arena.New<Map>(m_Arena);
 	entriesMap->keyType = BinType::HASH;
 	entriesMap->valueType = BinType::EMBEDDED;
 
-	m_entriesBin = new BinField;
-	m_entriesBin->type = BinType::MAP;
-	m_entriesBin->data->map = entriesMap;
+	m_entriesBin = NewBinField(m_Arena, BinType::MAP, nullptr);
+	m_entriesBin->data.map = entriesMap;
 
 	size_t entriesCount = (size_t)input.MemRead<uint32_t>();
-	if (entriesCount > 0)
+	myassert(entriesCount > (input.m_Size - input.m_Pointer) / 4)
+	m_entriesStart = input.m_Pointer + entriesCount * 4;
+	if (indexPath != nullptr && LoadEntryIndex(indexPath, entriesCount))
+	{
+		input.m_Pointer = m_entriesEnd;
+	}
+	else if (entriesCount > 0)
 	{
-		uint32_t* entryTypes = (uint32_t*)input.MemRead(entriesCount * 4);
+		std::vector<uint32_t> entryTypes(entriesCount);
+		input.MemRead(entryTypes.data(), entriesCount * 4);
 
-		entriesMap->items.reserve(entriesCount);
+		m_entrySpans.reserve(entriesCount);
 		for (size_t i = 0; i < entriesCount; i++)
 		{
-			uint32_t entryLength = input.MemRead<uint32_t>();
-			uint32_t entryKeyHash = input.MemRead<uint32_t>();
-			uint16_t fieldCount = input.MemRead<uint16_t>();
-
-			PointerOrEmbed *embed = new PointerOrEmbed;
-			embed->name = entryTypes[i];
-			embed->items.reserve(fieldCount);
-
-			BinField *embedValue = new BinField;
-			embedValue->parent = m_entriesBin;
-			embedValue->type = BinType::EMBEDDED;
-			embedValue->data->pe = embed;
+			EntrySpan span;
+			span.length = input.MemRead<uint32_t>();
+			span.offset = input.m_Pointer;
+			span.keyHash = input.MemRead<uint32_t>();
+			span.classHash = entryTypes[i];
+			myassert(span.length < 4 + 2 || span.length > input.m_Size - span.offset)
+			input.m_Pointer = span.offset + span.length;
+			m_entrySpans.emplace_back(span);
+		}
+	}
+	m_entriesEnd = input.m_Pointer;
 
-			BinField *hashKey = new BinField;
-			hashKey->parent = m_entriesBin;
-			hashKey->type = BinType::HASH;
-			hashKey->data->ui32 = entryKeyHash;
+	entriesMap->items.reserve(m_entrySpans.size());
+	for (size_t i = 0; i < m_entrySpans.size(); i++)
+	{
+		PointerOrEmbed *embed = m_Arena.New<PointerOrEmbed>(m_Arena);
+		embed->name = m_entrySpans[i].classHash;
 
-			MapPair pair;
-			pair.key = hashKey;
-			pair.value = embedValue;
-			entriesMap->items.emplace_back(pair);
+		BinField *embedValue = NewBinField(m_Arena, BinType::EMBEDDED, m_entriesBin);
+		embedValue->data.pe = embed;
+		m_entrySpans[i].value = embedValue;
 
-			for (uint16_t o = 0; o < fieldCount; o++)
-			{
-				uint32_t name = input.MemRead<uint32_t>();
-				uint8_t type = input.MemRead<uint8_t>();
+		BinField *hashKey = NewBinField(m_Arena, BinType::HASH, m_entriesBin);
+		hashKey->data.ui32 = m_entrySpans[i].keyHash;
 
-				EPField field;
-				field.key = name;
-				field.value = ReadValueByBinFieldType(type, hashT, embedValue, input);
-				embed->items.emplace_back(field);
-			}
-		}
+		MapPair pair;
+		pair.key = hashKey;
+		pair.value = embedValue;
+		entriesMap->items.emplace_back(pair);
 	}
 
-	Map *patchMap = new Map;
+	if (!lazy)
+		LoadAllEntries();
+
+	Map *patchMap = m_Arena.New<Map>(m_Arena);
 	patchMap->keyType = BinType::HASH;
 	patchMap->valueType = BinType::EMBEDDED;
 
-	m_patchesBin = new BinField;
-	m_patchesBin->type = BinType::MAP;
-	m_patchesBin->data->map = patchMap;
+	m_patchesBin = NewBinField(m_Arena, BinType::MAP, nullptr);
+	m_patchesBin->data.map = patchMap;
 
 	if (m_isPatch && m_Version >= 3) 
 	{
@@ -500,22 +1174,18 @@ int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
 
 				uint8_t type = input.MemRead<uint8_t>();
 				size_t stringLength = input.MemRead<uint16_t>();
-				char* string = new char[stringLength + 1];
+				char* string = m_Arena.NewArray<char>(stringLength + 1);
 				input.MemRead(string, stringLength);
 				string[stringLength] = '\0';
 
-				PointerOrEmbed *embed = new PointerOrEmbed;
+				PointerOrEmbed *embed = m_Arena.New<PointerOrEmbed>(m_Arena);
 				embed->name = patchFNV;
 
-				BinField *embedValue = new BinField;
-				embedValue->parent = m_patchesBin;
-				embedValue->type = BinType::EMBEDDED;
-				embedValue->data->pe = embed;
+				BinField *embedValue = NewBinField(m_Arena, BinType::EMBEDDED, m_patchesBin);
+				embedValue->data.pe = embed;
 
-				BinField *stringBin = new BinField;
-				stringBin->parent = embedValue;
-				stringBin->type = BinType::STRING;
-				stringBin->data->string = string;
+				BinField *stringBin = NewBinField(m_Arena, BinType::STRING, embedValue);
+				stringBin->data.string = string;
 
 				EPField firstField;
 				firstField.key = pathFNV;
@@ -524,13 +1194,11 @@ int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
 
 				EPField secondField;
 				secondField.key = valueFNV;
-				secondField.value = ReadValueByBinFieldType(type, hashT, embedValue, input);
+				secondField.value = ReadValueByBinFieldType(type, m_Arena, embedValue, input, nullptr);
 				embed->items.emplace_back(secondField);
 
-				BinField *hashKey = new BinField;
-				hashKey->parent = m_patchesBin;
-				hashKey->type = BinType::HASH;
-				hashKey->data->ui32 = patchKeyHash;
+				BinField *hashKey = NewBinField(m_Arena, BinType::HASH, m_patchesBin);
+				hashKey->data.ui32 = patchKeyHash;
 
 				MapPair pair;
 				pair.key = hashKey;
@@ -540,15 +1208,233 @@ int PacketBin::DecodeBin(char* filePath, HashTable& hashT)
 		}
 	}
 
-	printf("Finished reading bin from file\n\n");
+	if (m_Verbose)
+		printf("Finished reading bin from file\n\n");
 	return 1;
 }
 
-int PacketBin::EncodeBin(char* filePath)
+static size_t GetEntrySize(MapPair& entry)
 {
-	printf("Creating bin file: %s\n", filePath);
-	CharMemVector output;
+	PointerOrEmbed *pe = entry.value->data.pe;
+	size_t size = 4 + 4 + 2;
+	for (size_t k = 0; k < pe->items.size(); k++)
+		size += 4 + 1 + GetTotalBinFieldSize(pe->items[k].value);
+	return size;
+}
 
+static size_t GetPatchSize(MapPair& patch)
+{
+	PointerOrEmbed *pe = patch.value->data.pe;
+	size_t size = 4 + 4 + 1 + 2 + strlen(pe->items[0].value->data.string);
+	return size + GetTotalBinFieldSize(pe->items[1].value);
+}
+
+static void WriteEntry(MapPair& entry, CharMemVector& output)
+{
+	uint32_t entryKeyHash = entry.key->data.ui32;
+
+	PointerOrEmbed *pe = entry.value->data.pe;
+	uint16_t fieldCount = (uint16_t)pe->items.size();
+
+	size_t lengthOffset = output.MemReserve(4);
+	output.MemWrite(entryKeyHash);
+	output.MemWrite(fieldCount);
+
+	for (uint16_t k = 0; k < fieldCount; k++)
+	{
+		uint8_t type = TypeToUint8(pe->items[k].value->type);
+
+		output.MemWrite(pe->items[k].key);
+		output.MemWrite(type);
+
+		WriteValueByBinField(pe->items[k].value, output);
+	}
+
+	output.MemPatch(lengthOffset, (uint32_t)(output.MemSize() - lengthOffset - 4));
+}
+
+uint64_t PacketBin::GetEntryHash(size_t index)
+{
+	MapPair& entry = m_entriesBin->data.map->items[index];
+	uint32_t keyHash = entry.key->data.ui32;
+	uint64_t classHash = (uint64_t)entry.value->data.pe->name * PRIME1;
+
+	thread_local CharMemVector scratch;
+	scratch.m_Size = 0;
+
+	size_t spanIndex = FindEntrySpan(index);
+	if (m_File.m_Data != nullptr && spanIndex != SIZE_MAX && !m_entrySpans[spanIndex].dirty)
+	{
+		EntrySpan& span = m_entrySpans[spanIndex];
+		if (keyHash == span.keyHash)
+			return XXHash((const char*)m_File.m_Data + span.offset, span.length) ^ classHash;
+
+		// Renamed but never loaded, the fields are still the ones in the mapped file
+		scratch.MemWrite(keyHash);
+		scratch.MemWrite((void*)(m_File.m_Data + span.offset + 4), span.length - 4);
+		return XXHash((const char*)scratch.m_Array, scratch.m_Size) ^ classHash;
+	}
+
+	WriteEntry(entry, scratch);
+	return XXHash((const char*)scratch.m_Array + 4, scratch.m_Size - 4) ^ classHash;
+}
+
+static void WritePatch(MapPair& patch, CharMemVector& output)
+{
+	uint32_t patchKeyHash = patch.key->data.ui32;
+
+	PointerOrEmbed *pe = patch.value->data.pe;
+
+	char* string = pe->items[0].value->data.string;
+	uint16_t stringLen = (uint16_t)strlen(string);
+
+	output.MemWrite(patchKeyHash);
+	size_t lengthOffset = output.MemReserve(4);
+
+	uint8_t type = TypeToUint8(pe->items[1].value->type);
+	output.MemWrite(type);
+
+	output.MemWrite(stringLen);
+	output.MemWrite(string, stringLen);
+
+	WriteValueByBinField(pe->items[1].value, output);
+
+	output.MemPatch(lengthOffset, (uint32_t)(output.MemSize() - lengthOffset - 4));
+}
+
+static void GetItemOffsets(Map *map, bool patches, const std::vector<const uint8_t*>& sources, std::vector<size_t>& offsets)
+{
+	size_t itemsCount = map->items.size();
+	offsets.assign(itemsCount + 1, 0);
+
+	RunThreads(GetThreadCount(itemsCount), itemsCount, [&](size_t t, size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			if (i < sources.size() && sources[i] != nullptr)
+			{
+				uint32_t length;
+				memcpy(&length, sources[i], 4);
+				offsets[i + 1] = 4 + (size_t)length;
+			}
+			else
+				offsets[i + 1] = patches ? GetPatchSize(map->items[i]) : GetEntrySize(map->items[i]);
+		}
+	});
+
+	for (size_t i = 0; i < itemsCount; i++)
+		offsets[i + 1] += offsets[i];
+}
+
+static void WriteItem(Map *map, bool patches, const std::vector<const uint8_t*>& sources,
+	const std::vector<size_t>& offsets, size_t index, CharMemVector& output)
+{
+	if (index < sources.size() && sources[index] != nullptr)
+		output.MemWrite((void*)sources[index], offsets[index + 1] - offsets[index]);
+	else if (patches)
+		WritePatch(map->items[index], output);
+	else
+		WriteEntry(map->items[index], output);
+}
+
+static void WriteItems(Map *map, bool patches, const std::vector<const uint8_t*>& sources,
+	const std::vector<size_t>& offsets, CharMemVector& output)
+{
+	size_t itemsCount = map->items.size();
+	size_t threadCount = GetThreadCount(itemsCount);
+	if (threadCount <= 1)
+	{
+		for (size_t i = 0; i < itemsCount; i++)
+			WriteItem(map, patches, sources, offsets, i, output);
+		return;
+	}
+
+	auto writeRange = [&](uint8_t *base, size_t rangeFirst, size_t rangeLast)
+	{
+		size_t rangeThreads = threadCount < rangeLast - rangeFirst ? threadCount : rangeLast - rangeFirst;
+		RunThreads(rangeThreads, rangeLast - rangeFirst, [&](size_t t, size_t first, size_t last)
+		{
+			first += rangeFirst;
+			last += rangeFirst;
+			CharMemVector chunk(base + offsets[first] - offsets[rangeFirst], offsets[last] - offsets[first]);
+			for (size_t i = first; i < last; i++)
+				WriteItem(map, patches, sources, offsets, i, chunk);
+			myassert(chunk.MemSize() != offsets[last] - offsets[first])
+		});
+	};
+
+	if (output.m_Stream == nullptr)
+	{
+		writeRange(output.MemAppend(offsets[itemsCount]), 0, itemsCount);
+		return;
+	}
+
+	// Streams are encoded a window at a time so memory stays bounded by the window, not the file
+	size_t windowSize = threadCount * StreamBufferSize;
+	std::vector<uint8_t> buffer;
+	for (size_t first = 0; first < itemsCount;)
+	{
+		size_t last = first + 1;
+		while (last < itemsCount && offsets[last + 1] - offsets[first] <= windowSize)
+			last++;
+
+		buffer.resize(offsets[last] - offsets[first]);
+		writeRange(buffer.data(), first, last);
+		output.MemWrite(buffer.data(), buffer.size());
+		first = last;
+	}
+}
+
+void PacketBin::GetBinLayout(BinLayout& layout)
+{
+	size_t size = 4 + 4;
+	if (m_isPatch)
+		size += 4 + 8;
+
+	if (m_Version >= 2)
+	{
+		size += 4;
+		for (size_t i = 0; i < m_linkedList.size(); i++)
+			size += 2 + m_linkedList[i].length();
+	}
+
+	Map *entriesMap = m_entriesBin->data.map;
+	layout.entrySources.assign(entriesMap->items.size(), nullptr);
+	if (m_File.m_Data != nullptr)
+	{
+		for (size_t i = 0; i < entriesMap->items.size(); i++)
+		{
+			size_t spanIndex = FindEntrySpan(i);
+			if (spanIndex == SIZE_MAX)
+				continue;
+
+			EntrySpan& span = m_entrySpans[spanIndex];
+			if (span.dirty || entriesMap->items[i].key->data.ui32 != span.keyHash ||
+				entriesMap->items[i].value->data.pe->name != span.classHash)
+			{
+				if (!span.loaded)
+					LoadEntry(spanIndex, m_Arena, GetPoolArena());
+				continue;
+			}
+			myassert(!span.loaded && entriesMap->items[i].value->data.pe->items.size() != 0)
+			layout.entrySources[i] = m_File.m_Data + span.offset - 4;
+		}
+	}
+	GetItemOffsets(entriesMap, false, layout.entrySources, layout.entryOffsets);
+	size += 4 + entriesMap->items.size() * 4 + layout.entryOffsets.back();
+
+	layout.patchOffsets.clear();
+	if (m_isPatch && m_Version >= 3)
+	{
+		Map *patchesBin = m_patchesBin->data.map;
+		GetItemOffsets(patchesBin, true, std::vector<const uint8_t*>(), layout.patchOffsets);
+		size += 4 + layout.patchOffsets.back();
+	}
+	layout.totalSize = size;
+}
+
+void PacketBin::WriteBin(CharMemVector& output, const BinLayout& layout)
+{
 	if (m_isPatch)
 	{
 		output.MemWrite((void*)"PTCH", 4);
@@ -571,73 +1457,52 @@ int PacketBin::EncodeBin(char* filePath)
 		}
 	}
 
-	Map *entriesMap = m_entriesBin->data->map;
+	Map *entriesMap = m_entriesBin->data.map;
 	uint32_t entriesCount = (uint32_t)entriesMap->items.size();
 	output.MemWrite(entriesCount);
 
 	for (uint32_t i = 0; i < entriesCount; i++)
-		output.MemWrite(entriesMap->items[i].value->data->pe->name);
-
-	for (uint32_t i = 0; i < entriesCount; i++)
-	{
-		uint32_t entryLength = 4 + 2;
-		uint32_t entryKeyHash = entriesMap->items[i].key->data->ui32;
-
-		PointerOrEmbed *pe = entriesMap->items[i].value->data->pe;
-		uint16_t fieldCount = (uint16_t)pe->items.size();
-
-		for (uint16_t k = 0; k < fieldCount; k++)
-			entryLength += GetTotalBinFieldSize(pe->items[k].value) + 4 + 1;
-
-		output.MemWrite(entryLength);
-		output.MemWrite(entryKeyHash);
-		output.MemWrite(fieldCount);
-
-		for (uint16_t k = 0; k < fieldCount; k++)
-		{
-			uint8_t type = TypeToUint8(pe->items[k].value->type);
-
-			output.MemWrite(pe->items[k].key);
-			output.MemWrite(type);
+		output.MemWrite(entriesMap->items[i].value->data.pe->name);
 
-			WriteValueByBinField(pe->items[k].value, output);
-		}
-	}
+	WriteItems(entriesMap, false, layout.entrySources, layout.entryOffsets, output);
 
 	if (m_isPatch && m_Version >= 3)
 	{
-		Map *patchesBin = m_patchesBin->data->map;
+		Map *patchesBin = m_patchesBin->data.map;
 		uint32_t patchCount = (uint32_t)patchesBin->items.size();
 		output.MemWrite(patchCount);
 
-		for (uint32_t i = 0; i < patchCount; i++)
-		{
-			uint32_t patchKeyHash = patchesBin->items[i].key->data->ui32;
-			uint32_t patchLength = 1;
-
-			PointerOrEmbed *pe = patchesBin->items[i].value->data->pe;
-
-			char* string = pe->items[0].value->data->string;
-			uint16_t stringLen = (uint16_t)strlen(string);
+		WriteItems(patchesBin, true, std::vector<const uint8_t*>(), layout.patchOffsets, output);
+	}
+}
 
-			patchLength += 2 + stringLen;
-			patchLength += GetTotalBinFieldSize(pe->items[1].value);
+int PacketBin::EncodeBin(char* filePath)
+{
+	printf("Creating bin file: %s\n", filePath);
 
-			output.MemWrite(patchKeyHash);
-			output.MemWrite(patchLength);
+	if (m_File.m_Data != nullptr && m_File.IsSameFile(filePath))
+	{
+		LoadAllEntries();
+		for (size_t i = 0; i < m_entrySpans.size(); i++)
+			m_entrySpans[i].dirty = true;
+		m_File.Close();
+	}
 
-			uint8_t type = TypeToUint8(pe->items[1].value->type);
-			output.MemWrite(type);
+	BinLayout layout;
+	GetBinLayout(layout);
 
-			output.MemWrite(stringLen);
-			output.MemWrite(string, stringLen);
+	MappedFile mapped;
+	if (mapped.Create(filePath, layout.totalSize))
+	{
+		CharMemVector output(mapped.m_Data, layout.totalSize);
+		WriteBin(output, layout);
+		myassert(output.MemSize() != layout.totalSize)
+		mapped.Close();
 
-			WriteValueByBinField(pe->items[1].value, output);
-		}
+		printf("Finised creating bin file\n\n");
+		return 1;
 	}
 
-	printf("Finised creating bin file\n");
-
 	printf("Writing bin to file\n");
 
 	FILE *file;
@@ -650,8 +1515,9 @@ int PacketBin::EncodeBin(char* filePath)
 		return 0;
 	}
 
-	size_t arraySize = output.m_Array.size();
-	myassert(fwrite(output.m_Array.data(), 1, arraySize, file) != arraySize)
+	CharMemVector output(file, StreamBufferSize);
+	WriteBin(output, layout);
+	myassert(output.Flush() == 0)
 	fclose(file);
 
 	printf("Finised writing bin to file\n\n");
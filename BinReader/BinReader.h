@@ -5,11 +5,16 @@
 
 #include <unordered_map>
 #include <algorithm>
+#include <thread>
+#include <memory>
 #include <string>
 
 #include "Myassert.h"
 
 #include "Hashtable.h"
+#include "MappedFile.h"
+#include "Arena.h"
+#include "DedupPool.h"
 
 enum class BinType : uint8_t
 {
@@ -60,12 +65,15 @@ struct BinData
 	union
 	{
 		bool b;
+		float f32;
 		uint32_t ui32;
 		uint64_t ui64 = 0;
 
+		float vec[4];
+		uint8_t rgba[4];
+
 		union {
-			float* floatv;
-			uint8_t* rgba;
+			float* mtx;
 			char* string;
 
 			ContainerOrStructOrOption *cso;
@@ -78,7 +86,8 @@ struct BinData
 struct BinField
 {
 	BinType type = BinType::NONE;
-	BinData *data = new BinData;
+	bool shared = false;
+	BinData data;
 
 	BinField *parent = nullptr;
 };
@@ -98,22 +107,50 @@ struct MapPair
 struct ContainerOrStructOrOption
 {
 	BinType valueType = BinType::NONE;
-	std::vector<BinField*> items;
+	ArenaVector<BinField*> items;
+	ArenaVector<uint8_t> packed;
+
+	ContainerOrStructOrOption(Arena& arena) : items(arena), packed(arena) {}
 };
 
+// The lookup indexes are built on first use and rebuilt when the item count changes,
+// call InvalidateIndex after changing keys or reordering items in place. Pooled nodes
+// get their index before they are shared and only read it afterwards
 struct PointerOrEmbed
 {
 	uint32_t name = 0;
-	std::vector<EPField> items;
+	ArenaVector<EPField> items;
+	ArenaVector<uint32_t> index;
+	size_t indexedCount = 0;
+
+	PointerOrEmbed(Arena& arena) : items(arena), index(arena) {}
+
+	size_t FindItem(uint32_t key);
+	BinField *FindField(uint32_t key);
+	void UpdateIndex();
+	void InvalidateIndex() { index.clear(); }
 };
 
 struct Map
 {
 	BinType keyType = BinType::NONE;
 	BinType valueType = BinType::NONE;
-	std::vector<MapPair> items;
+	ArenaVector<MapPair> items;
+	ArenaVector<uint32_t> index;
+	size_t indexedCount = 0;
+
+	Map(Arena& arena) : items(arena), index(arena) {}
+
+	// Integer and hash keys match by value, string keys by FNV1Hash
+	size_t FindItem(uint64_t key);
+	BinField *FindValue(uint64_t key);
+	BinField *FindValue(const char* key);
+	void UpdateIndex();
+	void InvalidateIndex() { index.clear(); }
 };
 
+const size_t IndexThreshold = 8;
+
 static const size_t Type_size[] = {
 	0, //NONE
 	1, //BOOLB
@@ -130,10 +167,150 @@ static const size_t Type_size[] = {
 	1 //FLAG
 };
 
+BinField *NewBinField(Arena& arena, BinType type, BinField *parent);
+BinField *CloneBinField(Arena& arena, const BinField *value, BinField *parent);
+BinField *MakeWritable(Arena& arena, BinField *&value, BinField *parent);
+bool MatchesBinFieldBytes(BinField *value, const uint8_t* data, size_t size);
+
+bool IsPackedBinType(BinType type);
+size_t GetItemCount(const ContainerOrStructOrOption *cs);
+void AppendPackedItem(ContainerOrStructOrOption *cs, const BinField *item);
+uint64_t GetMapKeyValue(const BinField *key);
+
 const uint32_t patchFNV = 0xf9100aa9; // FNV1Hash("patch")
 const uint32_t pathFNV = 0x84874d36; // FNV1Hash("path")
 const uint32_t valueFNV = 0x425ed3ca;  // FNV1Hash("value")
 
+const uint32_t EntryIndexVersion = 2;
+const size_t StreamBufferSize = 1024 * 1024;
+
+class CharMemVector
+{
+public:
+	uint8_t *m_Array = nullptr;
+	size_t m_Size = 0;
+	size_t m_Capacity = 0;
+	size_t m_Flushed = 0;
+	FILE *m_Stream = nullptr;
+	bool m_Owned = true;
+
+	CharMemVector() {}
+	CharMemVector(uint8_t *buffer, size_t size) : m_Array(buffer), m_Capacity(size), m_Owned(false) {}
+	CharMemVector(FILE *stream, size_t bufferSize) : m_Stream(stream)
+	{
+		m_Array = (uint8_t*)malloc(bufferSize);
+		m_Capacity = bufferSize;
+	}
+	~CharMemVector()
+	{
+		if (m_Owned)
+			free(m_Array);
+	}
+
+	CharMemVector(const CharMemVector&) = delete;
+	CharMemVector& operator=(const CharMemVector&) = delete;
+
+	template<typename T>
+	void MemWrite(T value)
+	{
+		MemWrite((void*)&value, sizeof(T));
+	}
+
+	void MemWrite(void *value, size_t size)
+	{
+		if (size > m_Capacity - m_Size)
+		{
+			MemWriteSlow(value, size);
+			return;
+		}
+		memcpy(m_Array + m_Size, value, size);
+		m_Size += size;
+	}
+
+	size_t MemReserve(size_t size)
+	{
+		size_t offset = MemSize();
+		memset(MemAppend(size), 0, size);
+		return offset;
+	}
+
+	uint8_t *MemAppend(size_t size)
+	{
+		if (size > m_Capacity - m_Size)
+			MemGrow(size);
+		uint8_t *pointer = m_Array + m_Size;
+		m_Size += size;
+		return pointer;
+	}
+
+	template<typename T>
+	void MemPatch(size_t offset, T value)
+	{
+		if (offset < m_Flushed)
+		{
+			MemPatchStream(offset, &value, sizeof(T));
+			return;
+		}
+		myassert(offset - m_Flushed + sizeof(T) > m_Size)
+		memcpy(m_Array + (offset - m_Flushed), &value, sizeof(T));
+	}
+
+	size_t MemSize()
+	{
+		return m_Flushed + m_Size;
+	}
+
+	int Flush();
+
+private:
+	void MemWriteSlow(void *value, size_t size);
+	void MemGrow(size_t size);
+	void MemPatchStream(size_t offset, void *value, size_t size);
+};
+
+struct BinLayout
+{
+	std::vector<const uint8_t*> entrySources;
+	std::vector<size_t> entryOffsets;
+	std::vector<size_t> patchOffsets;
+	size_t totalSize = 0;
+};
+
+size_t GetThreadCount(size_t itemsCount);
+
+template<typename Function>
+void RunThreads(size_t threadCount, size_t itemsCount, Function function)
+{
+	if (threadCount <= 1)
+	{
+		function(0, 0, itemsCount);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount);
+	for (size_t t = 0; t < threadCount; t++)
+	{
+		size_t first = itemsCount * t / threadCount;
+		size_t last = itemsCount * (t + 1) / threadCount;
+		threads.emplace_back([&function, t, first, last]() { function(t, first, last); });
+	}
+
+	for (size_t t = 0; t < threadCount; t++)
+		threads[t].join();
+}
+
+struct EntrySpan
+{
+	uint32_t keyHash = 0;
+	uint32_t classHash = 0;
+	uint32_t length = 0;
+	size_t offset = 0;
+	BinField *value = nullptr;
+	bool loaded = false;
+	bool dirty = false;
+};
+
 class PacketBin
 {
 public:
@@ -143,54 +320,92 @@ public:
 	BinField *m_entriesBin = nullptr;
 	BinField *m_patchesBin = nullptr;
 	std::vector<std::string> m_linkedList;
+	std::vector<EntrySpan> m_entrySpans;
+	std::unordered_map<uint32_t, size_t> m_entryIndex;
+	std::unordered_multimap<uint32_t, size_t> m_spanIndex;
+	std::once_flag m_spanIndexOnce;
+	size_t m_entriesStart = 0;
+	size_t m_entriesEnd = 0;
+	MappedFile m_File;
+	Arena m_Arena;
+	std::vector<std::unique_ptr<Arena>> m_workerArenas;
+	// Set before DecodeBin to share identical subtrees, shared nodes go through MakeWritable before edits
+	DedupPool *m_DedupPool = nullptr;
+	Arena *m_PoolArena = nullptr;
+	// Set before DecodeBin when several packets decode at once, 0 uses every core
+	size_t m_MaxThreads = 0;
+	bool m_Verbose = true;
 
 	PacketBin() {}
-	~PacketBin() {}
+	~PacketBin()
+	{
+		if (m_PoolArena != nullptr)
+			m_DedupPool->ReleaseArena(m_PoolArena);
+	}
+
+	PacketBin(const PacketBin&) = delete;
+	PacketBin& operator=(const PacketBin&) = delete;
 
 	int EncodeBin(char* filePath);
-	int DecodeBin(char* filePath, HashTable& hasht);
+	int DecodeBin(char* filePath, bool lazy = false, const char* indexPath = nullptr);
+
+	BinField *GetEntry(size_t index);
+	// Entries changed in place must be marked, clean ones are copied from the mapped file on encode
+	BinField *EditEntry(size_t index);
+	void MarkEntryDirty(size_t index);
+	BinField *FindEntry(uint32_t keyHash);
+	int FindEntryIndex(uint32_t keyHash, size_t& index);
+	// Hash of the entry's class and encoded bytes, taken from the mapped file when the entry is clean
+	uint64_t GetEntryHash(size_t index);
+	void LoadAllEntries();
+
+	int SaveEntryIndex(const char* indexPath);
+	void HarvestStrings(HashTable& hashT);
+
+	void GetBinLayout(BinLayout& layout);
+	void WriteBin(CharMemVector& output, const BinLayout& layout);
+
+private:
+	// Spans are in file order, entries are matched to them by key and value node so
+	// inserting, removing or reordering entries never pairs one with another's bytes
+	size_t FindEntrySpan(size_t index);
+	void LoadEntry(size_t spanIndex, Arena& arena, Arena *poolArena);
+	Arena *GetPoolArena();
+	int LoadEntryIndex(const char* indexPath, size_t entriesCount);
 };
 
-class CharMemVector
+class CharMemView
 {
 public:
 	size_t m_Pointer = 0;
-	std::vector<uint8_t> m_Array;
-
-	CharMemVector() {}
-	~CharMemVector() {}
-
-	template<typename T>
-	void MemWrite(T value)
-	{
-		MemWrite((void*)&value, sizeof(T));
-	}
-
-	void MemWrite(void *value, size_t size)
-	{
-		m_Array.insert(m_Array.end(), (uint8_t*)value, (uint8_t*)value + size);
-	}
+	size_t m_Size = 0;
+	const uint8_t *m_Array = nullptr;
 
+	CharMemView(const uint8_t *array, size_t size) : m_Size(size), m_Array(array) {}
+	~CharMemView() {}
 
 	template<typename T>
 	T MemRead()
 	{
-		return *(T*)MemRead(sizeof(T));
+		T value;
+		MemRead(&value, sizeof(T));
+		return value;
 	}
 
-	void *MemRead(size_t bytes)
+	const uint8_t *MemSkip(size_t bytes)
 	{
-		uint8_t* buffer = new uint8_t[bytes];
-		MemRead(buffer, bytes);
-		return buffer;
+		myassert(bytes > m_Size - m_Pointer)
+
+		const uint8_t *pointer = m_Array + m_Pointer;
+		m_Pointer += bytes;
+		return pointer;
 	}
 
 	void MemRead(void *buffer, size_t bytes)
 	{
-		auto arrayIt = m_Array.begin() + m_Pointer;
-		std::_Adl_verify_range(arrayIt, arrayIt + bytes);
+		myassert(bytes > m_Size - m_Pointer)
 
-		myassert(memcpy(buffer, m_Array.data() + m_Pointer, bytes) != buffer)
+		myassert(memcpy(buffer, m_Array + m_Pointer, bytes) != buffer)
 		m_Pointer += bytes;
 	}
 };
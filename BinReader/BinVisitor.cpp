@@ -0,0 +1,199 @@
+#include "BinVisitor.h"
+
+static BinVisitor skipVisitor;
+
+static void VisitValue(BinType type, CharMemView& input, BinVisitor& visitor)
+{
+	switch (type)
+	{
+		case BinType::STRING:
+		{
+			uint16_t stringLength = input.MemRead<uint16_t>();
+			visitor.Value(type, input.MemSkip(stringLength), stringLength);
+			break;
+		}
+		case BinType::CONTAINER:
+		case BinType::STRUCT:
+		{
+			BinType valueType = Uint8ToType(input.MemRead<uint8_t>());
+			uint32_t size = input.MemRead<uint32_t>();
+			uint32_t fieldCount = input.MemRead<uint32_t>();
+			myassert(size < 4)
+
+			if (!visitor.BeginContainer(type, valueType, fieldCount))
+			{
+				input.MemSkip(size - 4);
+				break;
+			}
+			for (uint32_t i = 0; i < fieldCount; i++)
+				VisitValue(valueType, input, visitor);
+			visitor.End(type);
+			break;
+		}
+		case BinType::POINTER:
+		case BinType::EMBEDDED:
+		{
+			uint32_t name = input.MemRead<uint32_t>();
+			if (name == 0)
+			{
+				if (visitor.BeginEmbed(type, name, 0))
+					visitor.End(type);
+				break;
+			}
+
+			uint32_t size = input.MemRead<uint32_t>();
+			uint16_t fieldCount = input.MemRead<uint16_t>();
+			myassert(size < 2)
+
+			if (!visitor.BeginEmbed(type, name, fieldCount))
+			{
+				input.MemSkip(size - 2);
+				break;
+			}
+			for (uint16_t i = 0; i < fieldCount; i++)
+			{
+				uint32_t fieldName = input.MemRead<uint32_t>();
+				BinType fieldType = Uint8ToType(input.MemRead<uint8_t>());
+
+				visitor.Field(fieldName, fieldType);
+				VisitValue(fieldType, input, visitor);
+			}
+			visitor.End(type);
+			break;
+		}
+		case BinType::OPTION:
+		{
+			BinType valueType = Uint8ToType(input.MemRead<uint8_t>());
+			uint8_t fieldCount = input.MemRead<uint8_t>();
+
+			BinVisitor& itemVisitor = visitor.BeginContainer(type, valueType, fieldCount) ? visitor : skipVisitor;
+			for (uint8_t i = 0; i < fieldCount; i++)
+				VisitValue(valueType, input, itemVisitor);
+			if (&itemVisitor == &visitor)
+				visitor.End(type);
+			break;
+		}
+		case BinType::MAP:
+		{
+			BinType keyType = Uint8ToType(input.MemRead<uint8_t>());
+			BinType valueType = Uint8ToType(input.MemRead<uint8_t>());
+			uint32_t size = input.MemRead<uint32_t>();
+			uint32_t fieldCount = input.MemRead<uint32_t>();
+			myassert(size < 4)
+
+			if (!visitor.BeginMap(keyType, valueType, fieldCount))
+			{
+				input.MemSkip(size - 4);
+				break;
+			}
+			for (uint32_t i = 0; i < fieldCount; i++)
+			{
+				VisitValue(keyType, input, visitor);
+				VisitValue(valueType, input, visitor);
+			}
+			visitor.End(type);
+			break;
+		}
+		default:
+		{
+			size_t size = Type_size[(uint8_t)type];
+			visitor.Value(type, input.MemSkip(size), size);
+			break;
+		}
+	}
+}
+
+int VisitBin(const uint8_t* data, size_t size, BinVisitor& visitor)
+{
+	CharMemView input(data, size);
+
+	bool isPatch = false;
+	uint32_t signature = input.MemRead<uint32_t>();
+	if (memcmp(&signature, "PTCH", 4) == 0)
+	{
+		input.MemSkip(8);
+		input.MemRead(&signature, 4);
+		isPatch = true;
+	}
+	if (memcmp(&signature, "PROP", 4) != 0)
+	{
+		printf("Bin has no valid signature\n");
+		return 0;
+	}
+
+	uint32_t version = input.MemRead<uint32_t>();
+	visitor.Header(isPatch, version);
+
+	if (version >= 2)
+	{
+		uint32_t linkedCount = input.MemRead<uint32_t>();
+		for (uint32_t i = 0; i < linkedCount; i++)
+		{
+			uint16_t stringLength = input.MemRead<uint16_t>();
+			visitor.Linked((const char*)input.MemSkip(stringLength), stringLength);
+		}
+	}
+
+	uint32_t entriesCount = input.MemRead<uint32_t>();
+	const uint8_t *entryTypes = input.MemSkip(entriesCount * 4);
+	for (uint32_t i = 0; i < entriesCount; i++)
+	{
+		uint32_t classHash;
+		memcpy(&classHash, entryTypes + i * 4, 4);
+
+		uint32_t entryLength = input.MemRead<uint32_t>();
+		size_t entryEnd = input.m_Pointer + entryLength;
+		uint32_t entryKeyHash = input.MemRead<uint32_t>();
+		uint16_t fieldCount = input.MemRead<uint16_t>();
+		myassert(entryLength < 4 + 2 || entryEnd > input.m_Size)
+
+		if (!visitor.BeginEntry(entryKeyHash, classHash, fieldCount))
+		{
+			input.m_Pointer = entryEnd;
+			continue;
+		}
+		for (uint16_t o = 0; o < fieldCount; o++)
+		{
+			uint32_t name = input.MemRead<uint32_t>();
+			BinType type = Uint8ToType(input.MemRead<uint8_t>());
+
+			visitor.Field(name, type);
+			VisitValue(type, input, visitor);
+		}
+		visitor.EndEntry();
+	}
+
+	if (isPatch && version >= 3)
+	{
+		uint32_t patchCount = input.MemRead<uint32_t>();
+		for (uint32_t i = 0; i < patchCount; i++)
+		{
+			uint32_t patchKeyHash = input.MemRead<uint32_t>();
+			uint32_t patchLength = input.MemRead<uint32_t>();
+			size_t patchEnd = input.m_Pointer + patchLength;
+			myassert(patchEnd > input.m_Size)
+
+			BinType type = Uint8ToType(input.MemRead<uint8_t>());
+			uint16_t stringLength = input.MemRead<uint16_t>();
+			const char* path = (const char*)input.MemSkip(stringLength);
+
+			if (!visitor.BeginPatch(patchKeyHash, path, stringLength))
+			{
+				input.m_Pointer = patchEnd;
+				continue;
+			}
+			visitor.Field(valueFNV, type);
+			VisitValue(type, input, visitor);
+			visitor.EndPatch();
+		}
+	}
+	return 1;
+}
+
+int VisitBinFile(const char* filePath, BinVisitor& visitor)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+		return 0;
+	return VisitBin(file.m_Data, file.m_Size, visitor);
+}
\ No newline at end of file
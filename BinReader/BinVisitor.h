@@ -0,0 +1,33 @@
+#ifndef _BINVISITOR_H_
+#define _BINVISITOR_H_
+
+#include "BinReader.h"
+
+// Returning false from a Begin call skips that subtree, End is not called for it
+class BinVisitor
+{
+public:
+	BinVisitor() {}
+	virtual ~BinVisitor() {}
+
+	virtual void Header(bool isPatch, uint32_t version) {}
+	virtual void Linked(const char* string, uint16_t stringLength) {}
+
+	virtual bool BeginEntry(uint32_t keyHash, uint32_t classHash, uint16_t fieldCount) { return true; }
+	virtual void EndEntry() {}
+	virtual bool BeginPatch(uint32_t keyHash, const char* path, uint16_t pathLength) { return true; }
+	virtual void EndPatch() {}
+
+	virtual void Field(uint32_t name, BinType type) {}
+	virtual void Value(BinType type, const uint8_t* data, size_t size) {}
+
+	virtual bool BeginContainer(BinType type, BinType valueType, uint32_t count) { return true; }
+	virtual bool BeginEmbed(BinType type, uint32_t name, uint16_t count) { return true; }
+	virtual bool BeginMap(BinType keyType, BinType valueType, uint32_t count) { return true; }
+	virtual void End(BinType type) {}
+};
+
+int VisitBin(const uint8_t* data, size_t size, BinVisitor& visitor);
+int VisitBinFile(const char* filePath, BinVisitor& visitor);
+
+#endif //_BINVISITOR_H_
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "DedupPool.h"
+#include "BinReader.h"
+
+Arena *DedupPool::AcquireArena()
+{
+	std::lock_guard<std::mutex> lock(m_ArenasMutex);
+	if (!m_FreeArenas.empty())
+	{
+		Arena *arena = m_FreeArenas.back();
+		m_FreeArenas.pop_back();
+		return arena;
+	}
+	m_Arenas.emplace_back(new Arena);
+	return m_Arenas.back().get();
+}
+
+void DedupPool::ReleaseArena(Arena *arena)
+{
+	std::lock_guard<std::mutex> lock(m_ArenasMutex);
+	m_FreeArenas.emplace_back(arena);
+}
+
+BinField *DedupPool::Find(uint8_t type, uint64_t hash, const uint8_t* data, size_t size)
+{
+	Shard& shard = m_Shards[hash % ShardCount];
+
+	BinField *candidates[4];
+	size_t candidateCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto range = shard.table.equal_range(hash);
+		for (auto it = range.first; it != range.second && candidateCount < 4; ++it)
+			if (it->second.type == type && it->second.size == size)
+				candidates[candidateCount++] = it->second.value;
+	}
+
+	for (size_t i = 0; i < candidateCount; i++)
+	{
+		if (MatchesBinFieldBytes(candidates[i], data, size))
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.hits++;
+			return candidates[i];
+		}
+	}
+	return nullptr;
+}
+
+void DedupPool::Insert(uint8_t type, uint64_t hash, size_t size, BinField *value)
+{
+	Shard& shard = m_Shards[hash % ShardCount];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	PoolEntry entry;
+	entry.type = type;
+	entry.size = size;
+	entry.value = value;
+	shard.table.emplace(hash, entry);
+}
+
+size_t DedupPool::GetHitCount()
+{
+	size_t hits = 0;
+	for (size_t i = 0; i < ShardCount; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].mutex);
+		hits += m_Shards[i].hits;
+	}
+	return hits;
+}
+
+size_t DedupPool::GetNodeCount()
+{
+	size_t count = 0;
+	for (size_t i = 0; i < ShardCount; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].mutex);
+		count += m_Shards[i].table.size();
+	}
+	return count;
+}
+
+size_t DedupPool::GetAllocatedSize()
+{
+	std::lock_guard<std::mutex> lock(m_ArenasMutex);
+
+	size_t size = 0;
+	for (size_t i = 0; i < m_Arenas.size(); i++)
+		size += m_Arenas[i]->GetAllocatedSize();
+	return size;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef _DEDUPPOOL_H_
+#define _DEDUPPOOL_H_
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "Arena.h"
+
+struct BinField;
+
+// Shares identical decoded subtrees between the packets using it, keyed by the XXHash
+// of their raw bytes and verified by re-encoding the candidate, pooled nodes are
+// immutable and the pool must outlive every packet using it
+class DedupPool
+{
+public:
+	static const size_t MinSpanSize = 32;
+	static const size_t ShardCount = 16;
+
+	DedupPool() {}
+
+	DedupPool(const DedupPool&) = delete;
+	DedupPool& operator=(const DedupPool&) = delete;
+
+	// Arenas keep their pooled nodes after release and are handed out again to later loads
+	Arena *AcquireArena();
+	void ReleaseArena(Arena *arena);
+	BinField *Find(uint8_t type, uint64_t hash, const uint8_t* data, size_t size);
+	void Insert(uint8_t type, uint64_t hash, size_t size, BinField *value);
+
+	size_t GetHitCount();
+	size_t GetNodeCount();
+	size_t GetAllocatedSize();
+
+private:
+	struct PoolEntry
+	{
+		uint8_t type;
+		size_t size;
+		BinField *value;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_multimap<uint64_t, PoolEntry> table;
+		size_t hits = 0;
+	};
+
+	Shard m_Shards[ShardCount];
+	std::mutex m_ArenasMutex;
+	std::vector<std::unique_ptr<Arena>> m_Arenas;
+	std::vector<Arena*> m_FreeArenas;
+};
+
+struct DedupContext
+{
+	DedupPool *pool;
+	Arena *arena;
+};
+
+#endif //_DEDUPPOOL_H_
\ No newline at end of file
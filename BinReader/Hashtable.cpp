@@ -1,58 +1,345 @@
 #include "Hashtable.h"
+#include "BinReader.h"
 
-std::string HashTable::Lookup(const uint64_t key)
+const HashImageEntry *HashImage::Find(const uint64_t key) const
 {
-	auto found = table.find(key);
-	if (found != table.end())
-		return found->second;
-	return std::string();
+	const HashImageEntry* found = std::lower_bound(entries, entries + count, key,
+		[](const HashImageEntry& entry, uint64_t key) { return entry.key < key; });
+	if (found != entries + count && found->key == key)
+		return found;
+	return nullptr;
 }
 
-int HashTable::Insert(const uint64_t key, const std::string& val)
+static std::string_view SlotName(const char* name)
 {
-	if (HashTable::Lookup(key).size() == 0)
+	uint32_t length;
+	memcpy(&length, name - 4, 4);
+	return std::string_view(name, length);
+}
+
+static uint64_t MixKey(const uint64_t key)
+{
+	uint64_t hash = key * PRIME1;
+	return hash ^ (hash >> 32);
+}
+
+size_t HashTable::FindSlot(const HashSlots* slots, const uint64_t key, const uint64_t hash)
+{
+	size_t slot = (size_t)hash & slots->mask;
+	while (true)
 	{
-		table[key] = val;
-		return 1;
+		const HashSlot& current = slots->slots[slot];
+		if (current.name.load(std::memory_order_acquire) == nullptr || current.key == key)
+			return slot;
+		slot = (slot + 1) & slots->mask;
 	}
-	return 0;
 }
 
-void HashTable::LoadFromFile(const char* filePath)
+void HashTable::Rehash(HashShard& shard, size_t capacity)
 {
-	std::ifstream ifs(filePath);
-	if (!ifs.is_open())
+	std::unique_ptr<HashSlots> slots(new HashSlots);
+	slots->mask = capacity - 1;
+	slots->slots.reset(new HashSlot[capacity]);
+
+	HashSlots* old = shard.current.load(std::memory_order_relaxed);
+	if (old != nullptr)
 	{
-		char errMsg[255] = { "\0" };
-		strerror_s(errMsg, 255, errno);
-		printf("ERROR: Cannot read file %s %s\n", filePath, errMsg);
-		return;
+		for (size_t i = 0; i <= old->mask; i++)
+		{
+			const char* name = old->slots[i].name.load(std::memory_order_relaxed);
+			if (name == nullptr)
+				continue;
+			uint64_t key = old->slots[i].key;
+			HashSlot& slot = slots->slots[FindSlot(slots.get(), key, MixKey(key))];
+			slot.key = key;
+			slot.name.store(name, std::memory_order_relaxed);
+		}
 	}
 
-	size_t lines = 0;
-	std::string line = "";
+	shard.current.store(slots.get(), std::memory_order_release);
+	shard.tables.emplace_back(std::move(slots));
+}
+
+std::string_view HashTable::Lookup(const uint64_t key)
+{
+	if (parent != nullptr)
+	{
+		std::string_view name = parent->Lookup(key);
+		if (name.size() != 0)
+			return name;
+	}
+
+	uint64_t hash = MixKey(key);
+	const HashSlots* slots = m_Shards[hash >> 60].current.load(std::memory_order_acquire);
+	if (slots != nullptr)
+	{
+		const char* name = slots->slots[FindSlot(slots, key, hash)].name.load(std::memory_order_acquire);
+		if (name != nullptr)
+			return SlotName(name);
+	}
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const HashImageEntry* entry = images[i]->Find(key);
+		if (entry != nullptr)
+			return std::string_view(images[i]->strings + entry->offset, entry->length);
+	}
+	return std::string_view();
+}
+
+int HashTable::Insert(const uint64_t key, std::string_view val)
+{
+	if (HashTable::Lookup(key).size() != 0)
+		return 0;
+
+	uint64_t hash = MixKey(key);
+	HashShard& shard = m_Shards[hash >> 60];
+	std::lock_guard<std::mutex> lock(shard.mutex);
 
-	while (std::getline(ifs, line))
+	HashSlots* slots = shard.current.load(std::memory_order_relaxed);
+	if (slots == nullptr || (shard.count + 1) * 4 > (slots->mask + 1) * 3)
 	{
-		const size_t hashEnd = line.find(" ");
+		Rehash(shard, slots == nullptr ? 64 : (slots->mask + 1) * 2);
+		slots = shard.current.load(std::memory_order_relaxed);
+	}
+
+	HashSlot& slot = slots->slots[FindSlot(slots, key, hash)];
+	const char* existing = slot.name.load(std::memory_order_relaxed);
+	if (existing != nullptr && SlotName(existing).size() != 0)
+		return 0;
+
+	uint32_t length = (uint32_t)val.size();
+	uint8_t* name = (uint8_t*)shard.names.Allocate(4 + val.size() + 1, 4);
+	memcpy(name, &length, 4);
+	memcpy(name + 4, val.data(), val.size());
+	name[4 + val.size()] = '\0';
+
+	if (existing == nullptr)
+	{
+		slot.key = key;
+		shard.count++;
+	}
+	slot.name.store((const char*)name + 4, std::memory_order_release);
+	return 1;
+}
+
+void HashTable::Reserve(size_t count)
+{
+	for (size_t i = 0; i < HashShardCount; i++)
+	{
+		HashShard& shard = m_Shards[i];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		HashSlots* slots = shard.current.load(std::memory_order_relaxed);
+		size_t current = slots == nullptr ? 0 : slots->mask + 1;
+		size_t capacity = current < 64 ? 64 : current;
+		while ((shard.count + count / HashShardCount + 1) * 4 > capacity * 3)
+			capacity *= 2;
+		if (capacity != current)
+			Rehash(shard, capacity);
+	}
+}
+
+size_t HashTable::Size()
+{
+	size_t size = 0;
+	for (size_t i = 0; i < HashShardCount; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].mutex);
+		size += m_Shards[i].count;
+	}
+	for (size_t i = 0; i < images.size(); i++)
+		size += images[i]->count;
+	return size;
+}
 
-		uint64_t key = 0;
-		if (hashEnd == 8)
-			key = strtoul(line.c_str(), nullptr, 16);
-		else if (hashEnd == 16)
-			key = strtoull(line.c_str(), nullptr, 16);
+static int DecodeHex(const char* input, size_t length, uint64_t& value)
+{
+	value = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		uint8_t digit = (uint8_t)input[i];
+		if (digit >= '0' && digit <= '9')
+			digit -= '0';
+		else if ((digit | 0x20) >= 'a' && (digit | 0x20) <= 'f')
+			digit = (digit | 0x20) - 'a' + 10;
 		else
+			return 0;
+		value = (value << 4) | digit;
+	}
+	return 1;
+}
+
+struct HashLine
+{
+	uint64_t key;
+	std::string_view name;
+};
+
+// Each thread parses the lines starting inside its byte range, keys missing from the filter are dropped
+static void ParseHashLines(const char* data, size_t size, size_t first, size_t last, const std::unordered_set<uint64_t>* filter, std::vector<HashLine>& lines)
+{
+	while (first > 0 && first < size && data[first - 1] != '\n')
+		first++;
+
+	while (first < last)
+	{
+		const char* line = data + first;
+		const char* lineEnd = (const char*)memchr(line, '\n', size - first);
+		if (lineEnd == nullptr)
+			lineEnd = data + size;
+		first = lineEnd - data + 1;
+
+		size_t lineSize = lineEnd - line;
+		if (lineSize > 0 && line[lineSize - 1] == '\r')
+			lineSize--;
+
+		const char* hashEnd = (const char*)memchr(line, ' ', lineSize);
+		if (hashEnd == nullptr)
 			continue;
 
-		const std::string value = line.data() + hashEnd + 1;
-		lines += HashTable::Insert(key, value);
+		size_t hashSize = hashEnd - line;
+		uint64_t key;
+		if ((hashSize != 8 && hashSize != 16) || !DecodeHex(line, hashSize, key))
+			continue;
+		if (filter != nullptr && filter->find(key) == filter->end())
+			continue;
+
+		lines.push_back({ key, std::string_view(hashEnd + 1, lineSize - hashSize - 1) });
 	}
+}
+
+void HashTable::LoadFromFile(const char* filePath, const std::unordered_set<uint64_t>* filter)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+		return;
+
+	const char* data = (const char*)file.m_Data;
+	size_t threadCount = GetThreadCount(file.m_Size / 4096);
+	std::vector<std::vector<HashLine>> shards(threadCount > 1 ? threadCount : 1);
+	RunThreads(threadCount, file.m_Size, [&](size_t t, size_t first, size_t last)
+	{
+		if (filter == nullptr)
+			shards[t].reserve((last - first) / 48);
+		ParseHashLines(data, file.m_Size, first, last, filter, shards[t]);
+	});
 
-	ifs.close();
+	size_t total = 0;
+	for (size_t t = 0; t < shards.size(); t++)
+		total += shards[t].size();
+	Reserve(total);
+
+	size_t lines = 0;
+	for (size_t t = 0; t < shards.size(); t++)
+		for (size_t i = 0; i < shards[t].size(); i++)
+			lines += HashTable::Insert(shards[t][i].key, shards[t][i].name);
 
 	printf("File: %s loaded: %zd lines\n", filePath, lines);
 }
 
+int HashTable::LoadFromImage(const char* filePath)
+{
+	std::unique_ptr<HashImage> image(new HashImage);
+	if (!image->file.Open(filePath))
+		return 0;
+
+	const size_t headerSize = 4 + 4 + 8 + 8;
+	const uint8_t* data = image->file.m_Data;
+	if (image->file.m_Size < headerSize || memcmp(data, "HDIC", 4) != 0)
+	{
+		printf("ERROR: Dictionary %s has no valid signature\n", filePath);
+		return 0;
+	}
+
+	uint32_t version;
+	uint64_t count, stringsSize;
+	memcpy(&version, data + 4, 4);
+	memcpy(&count, data + 8, 8);
+	memcpy(&stringsSize, data + 16, 8);
+	if (version != HashImageVersion || count > (image->file.m_Size - headerSize) / sizeof(HashImageEntry) ||
+		image->file.m_Size != headerSize + count * sizeof(HashImageEntry) + stringsSize)
+	{
+		printf("ERROR: Dictionary %s is invalid or from another version\n", filePath);
+		return 0;
+	}
+
+	image->entries = (const HashImageEntry*)(data + headerSize);
+	image->strings = (const char*)(image->entries + count);
+	image->count = (size_t)count;
+	for (size_t i = 0; i < image->count; i++)
+	{
+		const HashImageEntry& entry = image->entries[i];
+		if ((i > 0 && image->entries[i - 1].key >= entry.key) || entry.offset > stringsSize || entry.length > stringsSize - entry.offset)
+		{
+			printf("ERROR: Dictionary %s is corrupted\n", filePath);
+			return 0;
+		}
+	}
+
+	images.emplace_back(std::move(image));
+
+	printf("File: %s loaded: %zd lines\n", filePath, (size_t)count);
+	return 1;
+}
+
+int HashTable::SaveToImage(const char* filePath)
+{
+	std::vector<HashImageEntry> entries;
+	entries.reserve(Size());
+	std::string strings;
+
+	for (size_t i = 0; i < HashShardCount; i++)
+	{
+		const HashSlots* slots = m_Shards[i].current.load(std::memory_order_acquire);
+		for (size_t k = 0; slots != nullptr && k <= slots->mask; k++)
+		{
+			const char* slotName = slots->slots[k].name.load(std::memory_order_acquire);
+			if (slotName == nullptr)
+				continue;
+			std::string_view name = SlotName(slotName);
+			entries.push_back({ slots->slots[k].key, (uint32_t)strings.size(), (uint32_t)name.size() });
+			strings += name;
+		}
+	}
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		HashImage* image = images[i].get();
+		for (size_t k = 0; k < image->count; k++)
+		{
+			const HashImageEntry& entry = image->entries[k];
+			entries.push_back({ entry.key, (uint32_t)strings.size(), entry.length });
+			strings.append(image->strings + entry.offset, entry.length);
+		}
+	}
+	myassert(strings.size() > UINT32_MAX)
+
+	std::stable_sort(entries.begin(), entries.end(), [](const HashImageEntry& a, const HashImageEntry& b) { return a.key < b.key; });
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const HashImageEntry& a, const HashImageEntry& b) { return a.key == b.key; }), entries.end());
+
+	FILE *file;
+	errno_t err = fopen_s(&file, filePath, "wb");
+	if (err)
+	{
+		char errMsg[255] = { '\0' };
+		strerror_s(errMsg, 255, err);
+		printf("ERROR: Cannot write file %s %s\n", filePath, errMsg);
+		return 0;
+	}
+
+	uint64_t count = entries.size();
+	uint64_t stringsSize = strings.size();
+	myassert(fwrite("HDIC", 1, 4, file) != 4)
+	myassert(fwrite(&HashImageVersion, 4, 1, file) != 1)
+	myassert(fwrite(&count, 8, 1, file) != 1)
+	myassert(fwrite(&stringsSize, 8, 1, file) != 1)
+	myassert(fwrite(entries.data(), sizeof(HashImageEntry), entries.size(), file) != entries.size())
+	myassert(fwrite(strings.data(), 1, strings.size(), file) != strings.size())
+	fclose(file);
+
+	printf("File: %s written: %zd lines\n", filePath, entries.size());
+	return 1;
+}
+
 uint32_t FNV1Hash(const char* string, size_t stringLen)
 {
 	uint32_t Hash = 0x811c9dc5;
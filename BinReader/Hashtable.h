@@ -9,27 +9,93 @@
 #include <ctype.h>
 
 #include "Myassert.h"
+#include "MappedFile.h"
+#include "Arena.h"
 
-#include <unordered_map>
-#include <fstream>
+#include <unordered_set>
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <memory>
 #include <string>
+#include <vector>
 
-struct custom_hash {
-	uint64_t operator()(uint64_t x) const {
-		return x;
-	}
+static const uint32_t HashImageVersion = 1;
+
+// Entries are sorted by key and point into the string blob that follows them
+struct HashImageEntry
+{
+	uint64_t key;
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct HashImage
+{
+	MappedFile file;
+	const HashImageEntry *entries = nullptr;
+	const char *strings = nullptr;
+	size_t count = 0;
+
+	const HashImageEntry *Find(const uint64_t key) const;
+};
+
+static const size_t HashShardCount = 16;
+
+// Open addressing with linear probing, names live in the arena behind their 32 bit length.
+// The key is written before the name is published, readers never look at a key whose name is null
+struct HashSlot
+{
+	uint64_t key = 0;
+	std::atomic<const char*> name = nullptr;
 };
 
+struct HashSlots
+{
+	size_t mask;
+	std::unique_ptr<HashSlot[]> slots;
+};
+
+// Readers load the current slots without locking, writers hold the mutex and
+// keep every replaced slots array alive until the table is destroyed
+struct HashShard
+{
+	std::atomic<HashSlots*> current = nullptr;
+	std::vector<std::unique_ptr<HashSlots>> tables;
+	std::mutex mutex;
+	size_t count = 0;
+	Arena names;
+};
+
+// Lookup and Insert may be called from any number of threads, loading files and images may not
 class HashTable
 {
 public:
-	std::unordered_map<uint64_t, std::string, custom_hash> table;
+	std::vector<std::unique_ptr<HashImage>> images;
+	// Looked up before this table and checked by Insert, but never written to
+	HashTable *parent = nullptr;
 
 	HashTable() {}
+	explicit HashTable(HashTable *parent) : parent(parent) {}
 	~HashTable() {}
-	std::string Lookup(const uint64_t key);
-	int Insert(const uint64_t key, const std::string& val);
-	void LoadFromFile(const char* filePath);
+
+	HashTable(const HashTable&) = delete;
+	HashTable& operator=(const HashTable&) = delete;
+
+	std::string_view Lookup(const uint64_t key);
+	int Insert(const uint64_t key, std::string_view val);
+	void Reserve(size_t count);
+	size_t Size();
+	void LoadFromFile(const char* filePath, const std::unordered_set<uint64_t>* filter = nullptr);
+	int LoadFromImage(const char* filePath);
+	int SaveToImage(const char* filePath);
+
+private:
+	HashShard m_Shards[HashShardCount];
+
+	static size_t FindSlot(const HashSlots* slots, const uint64_t key, const uint64_t hash);
+	static void Rehash(HashShard& shard, size_t capacity);
 };
 
 uint32_t FNV1Hash(const char* string, size_t stringLen);
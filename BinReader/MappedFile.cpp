@@ -0,0 +1,182 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+int MappedFile::Open(const char* filePath)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("ERROR: Cannot read file %s %lu\n", filePath, GetLastError());
+		return 0;
+	}
+	m_FileHandle = file;
+
+	LARGE_INTEGER fsize;
+	myassert(GetFileSizeEx(file, &fsize) == 0)
+	m_Size = (size_t)fsize.QuadPart;
+	if (m_Size == 0)
+		return 1;
+
+	m_MappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_MappingHandle == NULL)
+	{
+		printf("ERROR: Cannot map file %s %lu\n", filePath, GetLastError());
+		Close();
+		return 0;
+	}
+
+	m_Data = (uint8_t*)MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (m_Data == nullptr)
+	{
+		printf("ERROR: Cannot map file %s %lu\n", filePath, GetLastError());
+		Close();
+		return 0;
+	}
+	return 1;
+}
+
+int MappedFile::Create(const char* filePath, size_t size)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filePath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+	m_FileHandle = file;
+	m_Size = size;
+
+	m_MappingHandle = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+	if (m_MappingHandle == NULL)
+	{
+		Close();
+		return 0;
+	}
+
+	m_Data = (uint8_t*)MapViewOfFile(m_MappingHandle, FILE_MAP_WRITE, 0, 0, 0);
+	if (m_Data == nullptr)
+	{
+		Close();
+		return 0;
+	}
+	return 1;
+}
+
+int MappedFile::IsSameFile(const char* filePath)
+{
+	if (m_FileHandle == nullptr)
+		return 0;
+
+	HANDLE file = CreateFileA(filePath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+
+	BY_HANDLE_FILE_INFORMATION mappedInfo, otherInfo;
+	int result = GetFileInformationByHandle(m_FileHandle, &mappedInfo) && GetFileInformationByHandle(file, &otherInfo) &&
+		mappedInfo.dwVolumeSerialNumber == otherInfo.dwVolumeSerialNumber &&
+		mappedInfo.nFileIndexHigh == otherInfo.nFileIndexHigh && mappedInfo.nFileIndexLow == otherInfo.nFileIndexLow;
+	CloseHandle(file);
+	return result;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data != nullptr)
+		UnmapViewOfFile(m_Data);
+	if (m_MappingHandle != nullptr)
+		CloseHandle(m_MappingHandle);
+	if (m_FileHandle != nullptr)
+		CloseHandle(m_FileHandle);
+	m_Data = nullptr;
+	m_MappingHandle = nullptr;
+	m_FileHandle = nullptr;
+	m_Size = 0;
+}
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int MappedFile::Open(const char* filePath)
+{
+	Close();
+
+	m_FileDescriptor = open(filePath, O_RDONLY);
+	if (m_FileDescriptor == -1)
+	{
+		printf("ERROR: Cannot read file %s %s\n", filePath, strerror(errno));
+		return 0;
+	}
+
+	struct stat fileStat;
+	myassert(fstat(m_FileDescriptor, &fileStat) == -1)
+	m_Size = (size_t)fileStat.st_size;
+	if (m_Size == 0)
+		return 1;
+
+	void *data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_FileDescriptor, 0);
+	if (data == MAP_FAILED)
+	{
+		printf("ERROR: Cannot map file %s %s\n", filePath, strerror(errno));
+		Close();
+		return 0;
+	}
+	madvise(data, m_Size, MADV_SEQUENTIAL);
+
+	m_Data = (uint8_t*)data;
+	return 1;
+}
+
+int MappedFile::Create(const char* filePath, size_t size)
+{
+	Close();
+
+	m_FileDescriptor = open(filePath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_FileDescriptor == -1)
+		return 0;
+	m_Size = size;
+
+	if (ftruncate(m_FileDescriptor, (off_t)size) == -1)
+	{
+		Close();
+		return 0;
+	}
+
+	void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_FileDescriptor, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return 0;
+	}
+
+	m_Data = (uint8_t*)data;
+	return 1;
+}
+
+int MappedFile::IsSameFile(const char* filePath)
+{
+	if (m_FileDescriptor == -1)
+		return 0;
+
+	struct stat mappedStat, otherStat;
+	if (fstat(m_FileDescriptor, &mappedStat) == -1 || stat(filePath, &otherStat) == -1)
+		return 0;
+	return mappedStat.st_dev == otherStat.st_dev && mappedStat.st_ino == otherStat.st_ino;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data != nullptr)
+		munmap(m_Data, m_Size);
+	if (m_FileDescriptor != -1)
+		close(m_FileDescriptor);
+	m_Data = nullptr;
+	m_FileDescriptor = -1;
+	m_Size = 0;
+}
+#endif
\ No newline at end of file
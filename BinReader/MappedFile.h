@@ -0,0 +1,38 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "Myassert.h"
+
+class MappedFile
+{
+public:
+	uint8_t *m_Data = nullptr;
+	size_t m_Size = 0;
+
+	MappedFile() {}
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	int Open(const char* filePath);
+	int Create(const char* filePath, size_t size);
+	int IsSameFile(const char* filePath);
+	void Close();
+
+private:
+#ifdef _WIN32
+	void *m_FileHandle = nullptr;
+	void *m_MappingHandle = nullptr;
+#else
+	int m_FileDescriptor = -1;
+#endif
+};
+
+#endif //_MAPPEDFILE_H_
\ No newline at end of file
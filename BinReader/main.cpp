@@ -3,30 +3,36 @@
 #include "cJSON.h"
 
 #include <string>
+#include <atomic>
+#include <thread>
 
 #include "Myassert.h"
 #include "Hashtable.h"
 #include "BinReader.h"
+#include "BinVisitor.h"
+#include "BinPatch.h"
+#include "BinQuery.h"
+#include "BinDiff.h"
 
 std::string HashToString(HashTable& hashT, const uint32_t hashValue)
 {
-    std::string strvalue = hashT.Lookup(hashValue);
-    if (strvalue.size() == 0)
-    {
-        strvalue.reserve(16);
-        myassert(sprintf_s(strvalue.data(), 16, "0x%08" PRIX32, hashValue) <= 0)
-    }
+    std::string_view name = hashT.Lookup(hashValue);
+    if (name.size() != 0)
+        return std::string(name);
+
+    char strvalue[16];
+    myassert(sprintf_s(strvalue, 16, "0x%08" PRIX32, hashValue) <= 0)
     return strvalue;
 }
 
 std::string HashToStringxx(HashTable& hashT, const uint64_t hashValue)
 {
-    std::string strvalue = hashT.Lookup(hashValue);
-    if (strvalue.size() == 0)
-    {
-        strvalue.reserve(32);
-        myassert(sprintf_s(strvalue.data(), 32, "0x%016" PRIX64, hashValue) <= 0)
-    }
+    std::string_view name = hashT.Lookup(hashValue);
+    if (name.size() != 0)
+        return std::string(name);
+
+    char strvalue[32];
+    myassert(sprintf_s(strvalue, 32, "0x%016" PRIX64, hashValue) <= 0)
     return strvalue;
 }
 
@@ -50,82 +56,99 @@ uint64_t HashFromStringxx(std::string string)
     return hashValue;
 }
 
-cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* json, const char* strdata)
+cJSON* WriteJsonValueByBinData(BinType type, BinData* data, HashTable& hashT, cJSON* json, const char* strdata)
 {
-    switch (value->type)
+    switch (type)
     {
-        case BinType::NONE:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNull());
-            break;
         case BinType::FLAG:
         case BinType::BOOLB:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateBool(value->data->b));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateBool(data->b));
             break;
         case BinType::SInt8:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jSInt8));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jSInt8));
             break;
         case BinType::UInt8:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jUInt8));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jUInt8));
             break;
         case BinType::SInt16:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jSInt16));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jSInt16));
             break;
         case BinType::UInt16:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jUInt16));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jUInt16));
             break;
         case BinType::SInt32:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jSInt32));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jSInt32));
             break;
         case BinType::UInt32:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jUInt32));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jUInt32));
             break;
         case BinType::SInt64:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jSInt64));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jSInt64));
             break;
         case BinType::UInt64:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&value->data->ui64, jUInt64));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->ui64, jUInt64));
             break;
         case BinType::Float32:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(value->data->floatv, jFloat32));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNumber(&data->f32, jFloat32));
             break;
         case BinType::VEC2:
         case BinType::VEC3:
         case BinType::VEC4:
         case BinType::MTX44:
         {
-            float* arr = value->data->floatv;
+            float* arr = data->vec;
             cJSON* jsonarr = cJSON_CreateArray();
-            for (size_t i = 0; i < Type_size[(uint8_t)value->type] / 4; i++)
+            for (size_t i = 0; i < Type_size[(uint8_t)type] / 4; i++)
                 cJSON_AddItemToArray(jsonarr, cJSON_CreateNumber(&arr[i], jFloat32));
             cJSON_AddItemToObject(json, strdata, jsonarr);
             break;
         }
         case BinType::RGBA:
         {
-            uint8_t* arr = value->data->rgba;
+            uint8_t* arr = data->rgba;
             cJSON* jsonarr = cJSON_CreateArray();
             for (int i = 0; i < 4; i++)
                 cJSON_AddItemToArray(jsonarr, cJSON_CreateNumber(&arr[i], jUInt8));
             cJSON_AddItemToObject(json, strdata, jsonarr);
             break;
         }
-        case BinType::STRING:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(value->data->string));
-            break;
         case BinType::HASH:
         case BinType::LINK:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(HashToString(hashT, value->data->ui32).c_str()));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(HashToString(hashT, data->ui32).c_str()));
             break;
         case BinType::WADENTRYLINK:
-            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(HashToStringxx(hashT, value->data->ui64).c_str()));
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(HashToStringxx(hashT, data->ui64).c_str()));
+            break;
+    }
+    return json;
+}
+
+cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* json, const char* strdata)
+{
+    if (IsPackedBinType(value->type))
+    {
+        BinData* data = value->type == BinType::MTX44 ? (BinData*)value->data.mtx : &value->data;
+        return WriteJsonValueByBinData(value->type, data, hashT, json, strdata);
+    }
+
+    switch (value->type)
+    {
+        case BinType::NONE:
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateNull());
+            break;
+        case BinType::STRING:
+            cJSON_AddItemToObject(json, strdata, cJSON_CreateString(value->data.string));
             break;
         case BinType::CONTAINER:
         case BinType::STRUCT:
         {
             cJSON* jsonarr = cJSON_CreateArray();
-            ContainerOrStructOrOption* cs = value->data->cso;
+            ContainerOrStructOrOption* cs = value->data.cso;
             cJSON_AddItemToObject(json, "containertype", cJSON_CreateString(Type_strings[(uint8_t)cs->valueType]));
             cJSON_AddItemToObject(json, strdata, jsonarr);
+            size_t packedSize = Type_size[(uint8_t)cs->valueType];
+            for (size_t i = 0; i < cs->packed.size(); i += packedSize)
+                WriteJsonValueByBinData(cs->valueType, (BinData*)&cs->packed[i], hashT, jsonarr, "data");
             for (uint32_t i = 0; i < cs->items.size(); i++)
             {
                 if (IsComplexBinType(cs->valueType))
@@ -144,7 +167,7 @@ cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* js
         case BinType::EMBEDDED:
         {
             cJSON* jsonarr = cJSON_CreateArray();
-            PointerOrEmbed* pe = value->data->pe;
+            PointerOrEmbed* pe = value->data.pe;
             cJSON_AddItemToObject(json, HashToString(hashT, pe->name).c_str(), jsonarr);
             for (uint16_t i = 0; i < pe->items.size(); i++)
             {
@@ -158,10 +181,13 @@ cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* js
         }
         case BinType::OPTION:
         {
-            ContainerOrStructOrOption* op = value->data->cso;
+            ContainerOrStructOrOption* op = value->data.cso;
             cJSON* jsonarr = cJSON_CreateArray();
             cJSON_AddItemToObject(json, "optiontype", cJSON_CreateString(Type_strings[(uint8_t)op->valueType]));
             cJSON_AddItemToObject(json, strdata, jsonarr);
+            size_t packedSize = Type_size[(uint8_t)op->valueType];
+            for (size_t i = 0; i < op->packed.size(); i += packedSize)
+                WriteJsonValueByBinData(op->valueType, (BinData*)&op->packed[i], hashT, jsonarr, "data");
             for (uint8_t i = 0; i < op->items.size(); i++)
             {
                 if (IsComplexBinType(op->valueType))
@@ -178,7 +204,7 @@ cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* js
         }
         case BinType::MAP:
         {
-            Map* mp = value->data->map;
+            Map* mp = value->data.map;
             cJSON* jsonarr = cJSON_CreateArray();
             cJSON_AddItemToObject(json, "keytype", cJSON_CreateString(Type_strings[(uint8_t)mp->keyType]));
             cJSON_AddItemToObject(json, "valuetype", cJSON_CreateString(Type_strings[(uint8_t)mp->valueType]));
@@ -212,13 +238,12 @@ cJSON* WriteJsonValueByBinFieldType(BinField* value, HashTable& hashT, cJSON* js
     return json;
 }
 
-BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject)
+BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject, Arena& arena)
 {
     int i = 0;
     cJSON* obj;
     cJSON* jdata = getobject ? cJSON_GetObjectItem(json, "data") : json;
-    BinField* result = new BinField;
-    result->type = typebin;
+    BinField* result = NewBinField(arena, typebin, nullptr);
     switch (typebin)
     {
         case BinType::SInt8:
@@ -229,74 +254,85 @@ BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject
         case BinType::UInt32:
         case BinType::SInt64:
         case BinType::UInt64:
-            memcpy(&result->data->ui64, jdata->value, Type_size[(uint8_t)typebin]);
+            memcpy(&result->data.ui64, jdata->value, Type_size[(uint8_t)typebin]);
             break;
         case BinType::FLAG:
         case BinType::BOOLB:
-            result->data->b = *(bool*)jdata->value;
+            result->data.b = *(bool*)jdata->value;
             break;
         case BinType::Float32:
-            result->data->floatv = (float*)jdata->value;
+            result->data.f32 = *(float*)jdata->value;
             break;
         case BinType::VEC2:
         case BinType::VEC3:
         case BinType::VEC4:
         case BinType::MTX44:
         {
-            float* data = new float[Type_size[(uint8_t)typebin] / 4];
+            float* data = result->data.vec;
+            if (typebin == BinType::MTX44)
+            {
+                data = arena.NewArray<float>(16);
+                result->data.mtx = data;
+            }
             for (i = 0, obj = jdata->child; obj != NULL; obj = obj->next, i++)
                 data[i] = *(float*)obj->value;
-            result->data->floatv = data;
             break;
         }
         case BinType::RGBA:
         {
-            uint8_t* data = new uint8_t[Type_size[(uint8_t)typebin]];
             for (i = 0, obj = jdata->child; obj != NULL; obj = obj->next, i++)
-                data[i] = *(uint8_t*)obj->value;
-            result->data->rgba = data;
+                result->data.rgba[i] = *(uint8_t*)obj->value;
             break;
         }
         case BinType::STRING:
-            result->data->string = (char*)jdata->value;
+            result->data.string = arena.NewString((char*)jdata->value, strlen((char*)jdata->value));
             break;
         case BinType::HASH:
         case BinType::LINK:
         {
             uint32_t data = HashFromString((char*)jdata->value);
-            result->data->ui32 = data;
+            result->data.ui32 = data;
             break;
         }
         case BinType::WADENTRYLINK:
         {
             uint64_t data = HashFromStringxx((char*)jdata->value);
-            result->data->ui64 = data;
+            result->data.ui64 = data;
             break;
         }
         case BinType::CONTAINER:
         case BinType::STRUCT:
         {
-            ContainerOrStructOrOption* tmpcs = new ContainerOrStructOrOption;
+            ContainerOrStructOrOption* tmpcs = arena.New<ContainerOrStructOrOption>(arena);
 
             tmpcs->valueType = FindTypeByString((char*)cJSON_GetObjectItem(json, "containertype")->value);
 
             cJSON* cs = cJSON_GetObjectItem(json, "data");
+            if (IsPackedBinType(tmpcs->valueType))
+            {
+                tmpcs->packed.reserve(cJSON_GetArraySize(cs) * Type_size[(uint8_t)tmpcs->valueType]);
+                for (i = 0, obj = cs->child; obj != NULL; obj = obj->next, i++)
+                    AppendPackedItem(tmpcs, ReadValuerFomJsonValue(tmpcs->valueType, obj, 0, arena));
+                result->data.cso = tmpcs;
+                break;
+            }
+
             tmpcs->items.reserve(cJSON_GetArraySize(cs));
 
             for (i = 0, obj = cs->child; obj != NULL; obj = obj->next, i++)
             { 
                 if (IsPointerOrEmbedded(tmpcs->valueType))
-                    tmpcs->items.emplace_back(ReadValuerFomJsonValue(tmpcs->valueType, obj->child, 0));
+                    tmpcs->items.emplace_back(ReadValuerFomJsonValue(tmpcs->valueType, obj->child, 0, arena));
                 else
-                    tmpcs->items.emplace_back(ReadValuerFomJsonValue(tmpcs->valueType, obj, 0));           
+                    tmpcs->items.emplace_back(ReadValuerFomJsonValue(tmpcs->valueType, obj, 0, arena));           
             }
-            result->data->cso = tmpcs;
+            result->data.cso = tmpcs;
             break;
         }
         case BinType::POINTER:
         case BinType::EMBEDDED:
         {
-            PointerOrEmbed* tmppe = new PointerOrEmbed;
+            PointerOrEmbed* tmppe = arena.New<PointerOrEmbed>(arena);
 
             cJSON* pe = getobject ? json->child->next->next : json;
             if (pe != NULL)
@@ -308,30 +344,38 @@ BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject
                 {
                     EPField field;
                     field.key = HashFromString((char*)cJSON_GetObjectItem(obj, "name")->value);
-                    field.value = ReadValuerFomJsonValue(FindTypeByString((char*)cJSON_GetObjectItem(obj, "type")->value), obj, 1);
+                    field.value = ReadValuerFomJsonValue(FindTypeByString((char*)cJSON_GetObjectItem(obj, "type")->value), obj, 1, arena);
                     tmppe->items.emplace_back(field);
                 }
             }
-            result->data->pe = tmppe;
+            result->data.pe = tmppe;
             break;
         }
         case BinType::OPTION:
         {
-            ContainerOrStructOrOption* tmpo = new ContainerOrStructOrOption;
+            ContainerOrStructOrOption* tmpo = arena.New<ContainerOrStructOrOption>(arena);
 
             tmpo->valueType = FindTypeByString((char*)cJSON_GetObjectItem(json, "optiontype")->value);
 
             cJSON* op = cJSON_GetObjectItem(json, "data");
+            if (IsPackedBinType(tmpo->valueType))
+            {
+                for (i = 0, obj = op->child; obj != NULL; obj = obj->next, i++)
+                    AppendPackedItem(tmpo, ReadValuerFomJsonValue(tmpo->valueType, obj, 0, arena));
+                result->data.cso = tmpo;
+                break;
+            }
+
             tmpo->items.reserve(cJSON_GetArraySize(op));
 
             for (i = 0, obj = op->child; obj != NULL; obj = obj->next, i++)
             {
                 if (IsComplexBinType(tmpo->valueType))
-                    tmpo->items.emplace_back(ReadValuerFomJsonValue(tmpo->valueType, obj->child, 0));
+                    tmpo->items.emplace_back(ReadValuerFomJsonValue(tmpo->valueType, obj->child, 0, arena));
                 else
-                    tmpo->items.emplace_back(ReadValuerFomJsonValue(tmpo->valueType, obj, 0));
+                    tmpo->items.emplace_back(ReadValuerFomJsonValue(tmpo->valueType, obj, 0, arena));
             }
-            result->data->cso = tmpo;
+            result->data.cso = tmpo;
             break;
         }
         case BinType::MAP:
@@ -340,7 +384,7 @@ BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject
             cJSON* value = cJSON_CreateObject();
             cJSON* map = cJSON_GetObjectItem(json, "data");
 
-            Map* tmpmap = new Map;
+            Map* tmpmap = arena.New<Map>(arena);
             tmpmap->items.reserve(cJSON_GetArraySize(map));
 
             tmpmap->keyType = FindTypeByString((char*)cJSON_GetObjectItem(json, "keytype")->value);
@@ -358,18 +402,100 @@ BinField* ReadValuerFomJsonValue(BinType typebin, cJSON* json, uint8_t getobject
                 if (IsPointerOrEmbedded(tmpmap->valueType))
                     value = value->child;
 
-                pairField.key = ReadValuerFomJsonValue(tmpmap->keyType, key, 0);
-                pairField.value = ReadValuerFomJsonValue(tmpmap->valueType, value, 0);
+                pairField.key = ReadValuerFomJsonValue(tmpmap->keyType, key, 0, arena);
+                pairField.value = ReadValuerFomJsonValue(tmpmap->valueType, value, 0, arena);
 
                 tmpmap->items.emplace_back(pairField);
             }
-            result->data->map = tmpmap;
+            result->data.map = tmpmap;
             break;
         }
     }
     return result;
 }
 
+class StatsVisitor : public BinVisitor
+{
+public:
+    size_t entries = 0;
+    size_t patches = 0;
+    size_t bytes[sizeof(Type_strings) / sizeof(Type_strings[0])] = { 0 };
+    size_t counts[sizeof(Type_strings) / sizeof(Type_strings[0])] = { 0 };
+
+    bool BeginEntry(uint32_t keyHash, uint32_t classHash, uint16_t fieldCount) override
+    {
+        entries++;
+        return true;
+    }
+    bool BeginPatch(uint32_t keyHash, const char* path, uint16_t pathLength) override
+    {
+        patches++;
+        return true;
+    }
+    void Value(BinType type, const uint8_t* data, size_t size) override
+    {
+        counts[(uint8_t)type]++;
+        bytes[(uint8_t)type] += size;
+    }
+    bool BeginContainer(BinType type, BinType valueType, uint32_t count) override
+    {
+        counts[(uint8_t)type]++;
+        return true;
+    }
+    bool BeginEmbed(BinType type, uint32_t name, uint16_t count) override
+    {
+        counts[(uint8_t)type]++;
+        return true;
+    }
+    bool BeginMap(BinType keyType, BinType valueType, uint32_t count) override
+    {
+        counts[(uint8_t)BinType::MAP]++;
+        return true;
+    }
+};
+
+class HashScanner : public BinVisitor
+{
+public:
+    std::unordered_set<uint64_t> hashes;
+
+    bool BeginEntry(uint32_t keyHash, uint32_t classHash, uint16_t fieldCount) override
+    {
+        hashes.insert(keyHash);
+        hashes.insert(classHash);
+        return true;
+    }
+    bool BeginPatch(uint32_t keyHash, const char* path, uint16_t pathLength) override
+    {
+        hashes.insert(keyHash);
+        return true;
+    }
+    void Field(uint32_t name, BinType type) override
+    {
+        hashes.insert(name);
+    }
+    void Value(BinType type, const uint8_t* data, size_t size) override
+    {
+        if (type == BinType::HASH || type == BinType::LINK)
+        {
+            uint32_t hash;
+            memcpy(&hash, data, 4);
+            hashes.insert(hash);
+        }
+        else if (type == BinType::WADENTRYLINK)
+        {
+            uint64_t hash;
+            memcpy(&hash, data, 8);
+            hashes.insert(hash);
+        }
+    }
+    bool BeginEmbed(BinType type, uint32_t name, uint16_t count) override
+    {
+        hashes.insert(name);
+        return true;
+    }
+};
+
 void strip_ext(char* fname)
 {
     char* end = fname + strlen(fname);
@@ -379,136 +505,366 @@ void strip_ext(char* fname)
         *end = '\0';
 }
 
-int main(int argc, char** argv)
+// cJSON_Delete only frees the top level, strings own their value but numbers point into the packet
+void FreeJsonTree(cJSON* item)
 {
-    if (argc != 3)
+    while (item != nullptr)
     {
-        printf("Usage: binreader -d file.bin\n");
-        printf("Usage: binreader -e file.json\n");
-        scanf_s("press enter to exit.");
-        return 1;
+        cJSON* next = item->next;
+        FreeJsonTree(item->child);
+        if (item->type == jstring)
+            free(item->value);
+        free(item->string);
+        free(item);
+        item = next;
     }
-    if (strcmp(argv[1], "-d") == 0)
+}
+
+// Called from several threads at once in batch mode, each bin harvests into its own table on top of
+// the shared dictionary so its json does not depend on the other bins of the batch
+int WriteJsonFile(char* filePath, HashTable& dictionary, size_t maxThreads, bool verbose)
+{
+    PacketBin packet;
+    packet.m_MaxThreads = maxThreads;
+    packet.m_Verbose = verbose;
+    if (!packet.DecodeBin(filePath))
+        return 0;
+
+    HashTable hashT(&dictionary);
+    packet.HarvestStrings(hashT);
+
+    if (verbose)
+        printf("Creating json file.\n");
+
+    cJSON* root = cJSON_CreateObject();
+
+    if (packet.m_isPatch)
     {
-        printf("Loading hashes\n");
+        cJSON_AddItemToObject(root, "Signature", cJSON_CreateString("PTCH"));
+        cJSON_AddItemToObject(root, "Unknown", cJSON_CreateNumber(&packet.m_Unknown, jUInt64));
+    }
+    else
+        cJSON_AddItemToObject(root, "Signature", cJSON_CreateString("PROP"));
 
-        HashTable hashT;
-        hashT.LoadFromFile("hashes.bintypes.txt");
-        hashT.LoadFromFile("hashes.binfields.txt");
-        hashT.LoadFromFile("hashes.binhashes.txt");
-        hashT.LoadFromFile("hashes.binentries.txt");
-#ifdef NDEBUG
-        hashT.LoadFromFile("hashes.game.txt");
-        hashT.LoadFromFile("hashes.lcu.txt");
-#endif
+    cJSON_AddItemToObject(root, "Version", cJSON_CreateNumber(&packet.m_Version, jUInt32));
 
-        hashT.Insert(0xf9100aa9, "patch");
-        hashT.Insert(0x84874d36, "path");
-        hashT.Insert(0x425ed3ca, "value");
+    if (packet.m_Version >= 2)
+    {
+        cJSON* linkedListarray = cJSON_CreateArray();
 
-        printf("Loaded total of hashes: %zd\n", hashT.table.size());
+        for (uint32_t i = 0; i < packet.m_linkedList.size(); i++)
+            cJSON_AddItemToArray(linkedListarray, cJSON_CreateString(packet.m_linkedList[i].c_str()));
 
-        printf("Finised loading hashes\n\n");
+        cJSON_AddItemToObject(root, "Linked", linkedListarray);
+    }
 
-        PacketBin packet;
-        packet.DecodeBin(argv[2], hashT);
+    cJSON* entriesarray = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "Entries", entriesarray);
 
-        printf("Creating json file.\n");
+    Map* entriesMap = packet.m_entriesBin->data.map;
+    for (size_t i = 0; i < entriesMap->items.size(); i++)
+    {
+        cJSON* entry = cJSON_CreateObject();
+        cJSON* entryarr = cJSON_CreateArray();
 
-        cJSON* root = cJSON_CreateObject();
+        PointerOrEmbed* pe = entriesMap->items[i].value->data.pe;
+        cJSON_AddItemToObject(entriesarray, HashToString(hashT, entriesMap->items[i].key->data.ui32).c_str(), entry);
+        cJSON_AddItemToObject(entry, HashToString(hashT, pe->name).c_str(), entryarr);
 
-        if (packet.m_isPatch)
+        for (size_t o = 0; o < pe->items.size(); o++)
         {
-            cJSON_AddItemToObject(root, "Signature", cJSON_CreateString("PTCH"));
-            cJSON_AddItemToObject(root, "Unknown", cJSON_CreateNumber(&packet.m_Unknown, jUInt64));
+            cJSON* entryobj = cJSON_CreateObject();
+            cJSON_AddItemToObject(entryobj, "name", cJSON_CreateString(HashToString(hashT, pe->items[o].key).c_str()));
+            cJSON_AddItemToObject(entryobj, "type", cJSON_CreateString(Type_strings[(uint8_t)pe->items[o].value->type]));
+
+            WriteJsonValueByBinFieldType(pe->items[o].value, hashT, entryobj, "data");
+
+            cJSON_AddItemToArray(entryarr, entryobj);
         }
-        else
-            cJSON_AddItemToObject(root, "Signature", cJSON_CreateString("PROP"));
+    }
 
-        cJSON_AddItemToObject(root, "Version", cJSON_CreateNumber(&packet.m_Version, jUInt32));
+    if (packet.m_isPatch && packet.m_Version >= 3)
+    {
+        cJSON* patchesarray = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, "Patches", patchesarray);
 
-        if (packet.m_Version >= 2)
+        Map* patchMap = packet.m_patchesBin->data.map;
+        for (size_t i = 0; i < patchMap->items.size(); i++)
         {
-            cJSON* linkedListarray = cJSON_CreateArray();
+            cJSON* patch = cJSON_CreateObject();
 
-            for (uint32_t i = 0; i < packet.m_linkedList.size(); i++)
-                cJSON_AddItemToArray(linkedListarray, cJSON_CreateString(packet.m_linkedList[i].c_str()));
+            PointerOrEmbed* pe = patchMap->items[i].value->data.pe;
+            cJSON_AddItemToObject(patchesarray, HashToString(hashT, patchMap->items[i].key->data.ui32).c_str(), patch);
 
-            cJSON_AddItemToObject(root, "Linked", linkedListarray);
+            cJSON_AddItemToObject(patch, "path", cJSON_CreateString(pe->items[0].value->data.string));
+
+            cJSON_AddItemToObject(patch, "type", cJSON_CreateString(Type_strings[(uint8_t)pe->items[1].value->type]));
+            WriteJsonValueByBinFieldType(pe->items[1].value, hashT, patch, "data");
         }
+    }
 
-        cJSON* entriesarray = cJSON_CreateObject();
-        cJSON_AddItemToObject(root, "Entries", entriesarray);
+    if (verbose)
+    {
+        printf("Finised creating json file.\n");
 
-        Map* entriesMap = packet.m_entriesBin->data->map;
-        for (size_t i = 0; i < entriesMap->items.size(); i++)
-        {
-            cJSON* entry = cJSON_CreateObject();
-            cJSON* entryarr = cJSON_CreateArray();
+        printf("Writing to file.\n");
+    }
 
-            PointerOrEmbed* pe = entriesMap->items[i].value->data->pe;
-            cJSON_AddItemToObject(entriesarray, HashToString(hashT, entriesMap->items[i].key->data->ui32).c_str(), entry);
-            cJSON_AddItemToObject(entry, HashToString(hashT, pe->name).c_str(), entryarr);
+    size_t argsize = strlen(filePath);
+    char* name = new char [argsize + 8];
+    memset(name, '\0', argsize + 8);
+    memcpy(name, filePath, argsize);
+    strip_ext(name);
+    memcpy(name + strlen(name), ".json", 5);
 
-            for (size_t o = 0; o < pe->items.size(); o++)
-            {
-                cJSON* entryobj = cJSON_CreateObject();
-                cJSON_AddItemToObject(entryobj, "name", cJSON_CreateString(HashToString(hashT, pe->items[o].key).c_str()));
-                cJSON_AddItemToObject(entryobj, "type", cJSON_CreateString(Type_strings[(uint8_t)pe->items[o].value->type]));
+    FILE* file;
+    errno_t err = fopen_s(&file, name, "wb");
+    if (err)
+    {
+        char errMsg[255] = { '\0' };
+        strerror_s(errMsg, 255, err);
+        printf("ERROR: Cannot write file %s %s\n", name, errMsg);
+        FreeJsonTree(root);
+        delete[] name;
+        return 0;
+    }
 
-                WriteJsonValueByBinFieldType(pe->items[o].value, hashT, entryobj, "data");
+    char* out = cJSON_Print(root, 1);
+    fwrite(out, strlen(out), 1, file);
 
-                cJSON_AddItemToArray(entryarr, entryobj);
-            }
+    fclose(file);
+    free(out);
+    FreeJsonTree(root);
+
+    if (verbose)
+        printf("Finised writing to file.\n");
+    else
+        printf("Converted %s to %s\n", filePath, name);
+    delete[] name;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    bool variadic = argc >= 2 && (strcmp(argv[1], "-p") == 0 || strcmp(argv[1], "-q") == 0);
+    bool batch = argc >= 2 && (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-l") == 0);
+    bool compare = argc >= 2 && strcmp(argv[1], "-c") == 0;
+    if (argc < 3 || (!variadic && !batch && argc != (compare ? 4 : 3)) || (variadic && argc < 4))
+    {
+        printf("Usage: binreader -d file.bin [file.bin ...]\n");
+        printf("Usage: binreader -l file.bin [file.bin ...]\n");
+        printf("Usage: binreader -e file.json\n");
+        printf("Usage: binreader -s file.bin\n");
+        printf("Usage: binreader -p file.bin patch.bin [patch.bin ...]\n");
+        printf("Usage: binreader -q file.bin query [query ...]\n");
+        printf("Usage: binreader -c old.bin new.bin\n");
+        printf("Usage: binreader -h hashes.bin\n");
+        scanf_s("press enter to exit.");
+        return 1;
+    }
+    if (strcmp(argv[1], "-s") == 0)
+    {
+        StatsVisitor stats;
+        if (!VisitBinFile(argv[2], stats))
+            return 1;
+
+        printf("Entries: %zd\n", stats.entries);
+        printf("Patches: %zd\n", stats.patches);
+        for (size_t i = 0; i < sizeof(Type_strings) / sizeof(Type_strings[0]); i++)
+        {
+            if (stats.counts[i] == 0)
+                continue;
+            if (stats.bytes[i] != 0)
+                printf("%s: %zd values %zd bytes\n", Type_strings[i], stats.counts[i], stats.bytes[i]);
+            else
+                printf("%s: %zd values\n", Type_strings[i], stats.counts[i]);
         }
+        return 0;
+    }
+    if (strcmp(argv[1], "-p") == 0)
+    {
+        PacketBin packet;
+        if (!packet.DecodeBin(argv[2], true))
+            return 1;
 
-        if (packet.m_isPatch && packet.m_Version >= 3)
+        std::vector<std::unique_ptr<PacketBin>> patches;
+        BinPatcher patcher(packet);
+        for (int i = 3; i < argc; i++)
         {
-            cJSON* patchesarray = cJSON_CreateObject();
-            cJSON_AddItemToObject(root, "Patches", patchesarray);
+            patches.emplace_back(new PacketBin);
+            if (!patches.back()->DecodeBin(argv[i]) || !patcher.AddPatch(*patches.back()))
+                return 1;
+        }
+        patcher.Apply();
+
+        printf("Applied %zd patches, skipped %zd\n\n", patcher.m_Applied, patcher.m_Skipped);
+
+        size_t argsize = strlen(argv[2]);
+        char* name = new char[argsize + 16];
+        memset(name, '\0', argsize + 16);
+        memcpy(name, argv[2], argsize);
+        strip_ext(name);
+        memcpy(name + strlen(name), ".patched.bin", 13);
 
-            Map* patchMap = packet.m_patchesBin->data->map;
-            for (size_t i = 0; i < patchMap->items.size(); i++)
+        if (!packet.EncodeBin(name))
+            return 1;
+        return 0;
+    }
+    if (strcmp(argv[1], "-q") == 0)
+    {
+        BinQuery query;
+        for (int i = 3; i < argc; i++)
+        {
+            if (!query.AddQuery(argv[i]))
             {
-                cJSON* patch = cJSON_CreateObject();
+                printf("ERROR: Invalid query %s\n", argv[i]);
+                return 1;
+            }
+        }
 
-                PointerOrEmbed* pe = patchMap->items[i].value->data->pe;
-                cJSON_AddItemToObject(patchesarray, HashToString(hashT, patchMap->items[i].key->data->ui32).c_str(), patch);
+        PacketBin packet;
+        packet.m_Verbose = false;
+        if (!packet.DecodeBin(argv[2], true))
+            return 1;
 
-                cJSON_AddItemToObject(patch, "path", cJSON_CreateString(pe->items[0].value->data->string));
+        std::vector<QueryMatch> matches;
+        query.Run(packet, matches);
 
-                cJSON_AddItemToObject(patch, "type", cJSON_CreateString(Type_strings[(uint8_t)pe->items[1].value->type]));
-                WriteJsonValueByBinFieldType(pe->items[1].value, hashT, patch, "data");
-            }
+        HashTable hashT;
+        cJSON* root = cJSON_CreateArray();
+        for (size_t i = 0; i < matches.size(); i++)
+        {
+            QueryMatch& match = matches[i];
+
+            cJSON* result = cJSON_CreateObject();
+            cJSON_AddItemToObject(result, "query", cJSON_CreateString(argv[3 + match.query]));
+            cJSON_AddItemToObject(result, "entry", cJSON_CreateString(HashToString(hashT, match.entryKey).c_str()));
+            cJSON_AddItemToObject(result, "type", cJSON_CreateString(Type_strings[(uint8_t)match.type]));
+            if (match.field != nullptr)
+                WriteJsonValueByBinFieldType(match.field, hashT, result, "data");
+            else
+                WriteJsonValueByBinData(match.type, match.data, hashT, result, "data");
+            cJSON_AddItemToArray(root, result);
         }
 
-        printf("Finised creating json file.\n");
+        char* out = cJSON_Print(root, 1);
+        printf("%s\n", out);
+        return 0;
+    }
+    if (strcmp(argv[1], "-h") == 0)
+    {
+        HashTable hashT;
+        hashT.LoadFromFile("hashes.bintypes.txt");
+        hashT.LoadFromFile("hashes.binfields.txt");
+        hashT.LoadFromFile("hashes.binhashes.txt");
+        hashT.LoadFromFile("hashes.binentries.txt");
+        hashT.LoadFromFile("hashes.game.txt");
+        hashT.LoadFromFile("hashes.lcu.txt");
 
-        printf("Writing to file.\n");
+        if (!hashT.SaveToImage(argv[2]))
+            return 1;
+        return 0;
+    }
+    if (compare)
+    {
+        PacketBin oldPacket, newPacket;
+        oldPacket.m_Verbose = false;
+        newPacket.m_Verbose = false;
+        if (!oldPacket.DecodeBin(argv[2], true) || !newPacket.DecodeBin(argv[3], true))
+            return 1;
 
-        size_t argsize = strlen(argv[2]);
-        char* name = new char [argsize + 8];
-        memset(name, '\0', argsize + 8);
-        memcpy(name, argv[2], argsize);
-        strip_ext(name);
-        memcpy(name + strlen(name), ".json", 5);
+        BinDiff diff;
+        std::vector<DiffChange> changes;
+        diff.Run(oldPacket, newPacket, changes);
 
-        FILE* file;
-        errno_t err = fopen_s(&file, name, "wb");
-        if (err)
+        const char* kinds[] = { "added", "removed", "changed" };
+
+        HashTable hashT;
+        cJSON* root = cJSON_CreateArray();
+        for (size_t i = 0; i < changes.size(); i++)
         {
-            char errMsg[255] = { '\0' };
-            strerror_s(errMsg, 255, err);
-            printf("ERROR: Cannot write file %s %s\n", name, errMsg);
-            return 0;
+            DiffChange& change = changes[i];
+            BinField* value = change.newValue != nullptr ? change.newValue : change.oldValue;
+
+            cJSON* result = cJSON_CreateObject();
+            cJSON_AddItemToObject(result, "change", cJSON_CreateString(kinds[(uint8_t)change.kind]));
+            cJSON_AddItemToObject(result, "path", cJSON_CreateString(change.path.c_str()));
+            cJSON_AddItemToObject(result, "type", cJSON_CreateString(Type_strings[(uint8_t)value->type]));
+            if (change.oldValue != nullptr)
+            {
+                cJSON* jsonold = cJSON_CreateObject();
+                WriteJsonValueByBinFieldType(change.oldValue, hashT, jsonold, "data");
+                cJSON_AddItemToObject(result, "old", jsonold);
+            }
+            if (change.newValue != nullptr)
+            {
+                cJSON* jsonnew = cJSON_CreateObject();
+                WriteJsonValueByBinFieldType(change.newValue, hashT, jsonnew, "data");
+                cJSON_AddItemToObject(result, "new", jsonnew);
+            }
+            cJSON_AddItemToArray(root, result);
         }
 
         char* out = cJSON_Print(root, 1);
-        fwrite(out, strlen(out), 1, file);
+        printf("%s\n", out);
+        return 0;
+    }
+    bool scan = strcmp(argv[1], "-l") == 0;
+    if (strcmp(argv[1], "-d") == 0 || scan)
+    {
+        HashScanner scanner;
+        if (scan)
+        {
+            printf("Scanning bin for hashes\n");
+            for (int i = 2; i < argc; i++)
+                if (!VisitBinFile(argv[i], scanner))
+                    return 1;
+            printf("Found %zd distinct hashes\n\n", scanner.hashes.size());
+        }
+        const std::unordered_set<uint64_t>* filter = scan ? &scanner.hashes : nullptr;
 
-        fclose(file);
+        printf("Loading hashes\n");
 
-        printf("Finised writing to file.\n");
+        HashTable hashT;
+        FILE* image;
+        if (fopen_s(&image, "hashes.bin", "rb") == 0)
+        {
+            fclose(image);
+            hashT.LoadFromImage("hashes.bin");
+        }
+        if (hashT.images.size() == 0)
+        {
+            hashT.LoadFromFile("hashes.bintypes.txt", filter);
+            hashT.LoadFromFile("hashes.binfields.txt", filter);
+            hashT.LoadFromFile("hashes.binhashes.txt", filter);
+            hashT.LoadFromFile("hashes.binentries.txt", filter);
+#ifdef NDEBUG
+            hashT.LoadFromFile("hashes.game.txt", filter);
+            hashT.LoadFromFile("hashes.lcu.txt", filter);
+#endif
+        }
+
+        hashT.Insert(0xf9100aa9, "patch");
+        hashT.Insert(0x84874d36, "path");
+        hashT.Insert(0x425ed3ca, "value");
+
+        printf("Loaded total of hashes: %zd\n", hashT.Size());
+
+        printf("Finised loading hashes\n\n");
+
+        std::atomic<int> next = 2;
+        std::atomic<int> failed = 0;
+        size_t coreCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        size_t threadCount = std::min<size_t>(coreCount, argc - 2);
+        size_t maxThreads = std::max<size_t>(coreCount / threadCount, 1);
+        RunThreads(threadCount, threadCount, [&](size_t t, size_t first, size_t last)
+        {
+            for (int i = next++; i < argc; i = next++)
+                if (!WriteJsonFile(argv[i], hashT, maxThreads, argc == 3))
+                    failed = 1;
+        });
+        if (failed)
+            return 1;
     }
     else if (strcmp(argv[1], "-e") == 0)
     {
@@ -566,13 +922,14 @@ int main(int argc, char** argv)
             }
         }
 
-        Map* entriesMap = new Map;
+        Arena& arena = packet.m_Arena;
+
+        Map* entriesMap = arena.New<Map>(arena);
         entriesMap->keyType = BinType::HASH;
         entriesMap->valueType = BinType::EMBEDDED;
 
-        packet.m_entriesBin = new BinField;
-        packet.m_entriesBin->type = BinType::MAP;
-        packet.m_entriesBin->data->map = entriesMap;
+        packet.m_entriesBin = NewBinField(arena, BinType::MAP, nullptr);
+        packet.m_entriesBin->data.map = entriesMap;
 
         cJSON* entries = cJSON_GetObjectItem(root, "Entries");
         uint32_t entriesCount = cJSON_GetArraySize(entries);
@@ -585,19 +942,15 @@ int main(int argc, char** argv)
                 uint32_t entryKeyHash = HashFromString(obj->string);
                 uint32_t fieldCount = cJSON_GetArraySize(obj->child);
 
-                PointerOrEmbed* embed = new PointerOrEmbed;
+                PointerOrEmbed* embed = arena.New<PointerOrEmbed>(arena);
                 embed->name = HashFromString(obj->child->string);
                 embed->items.reserve(fieldCount);
 
-                BinField* embedValue = new BinField;
-                embedValue->parent = packet.m_entriesBin;
-                embedValue->type = BinType::EMBEDDED;
-                embedValue->data->pe = embed;
+                BinField* embedValue = NewBinField(arena, BinType::EMBEDDED, packet.m_entriesBin);
+                embedValue->data.pe = embed;
 
-                BinField* hashKey = new BinField;
-                hashKey->parent = packet.m_entriesBin;
-                hashKey->type = BinType::HASH;
-                hashKey->data->ui32 = entryKeyHash;
+                BinField* hashKey = NewBinField(arena, BinType::HASH, packet.m_entriesBin);
+                hashKey->data.ui32 = entryKeyHash;
 
                 MapPair pair;
                 pair.key = hashKey;
@@ -610,20 +963,19 @@ int main(int argc, char** argv)
                     BinType typebin = FindTypeByString((char*)cJSON_GetObjectItem(obje, "type")->value);
 
                     field.key = HashFromString((char*)cJSON_GetObjectItem(obje, "name")->value);
-                    field.value = ReadValuerFomJsonValue(typebin, obje, 1);
+                    field.value = ReadValuerFomJsonValue(typebin, obje, 1, arena);
 
                     embed->items.emplace_back(field);
                 }
             }
         }
 
-        Map* patchMap = new Map;
+        Map* patchMap = arena.New<Map>(arena);
         patchMap->keyType = BinType::HASH;
         patchMap->valueType = BinType::EMBEDDED;
 
-        packet.m_patchesBin = new BinField;
-        packet.m_patchesBin->type = BinType::MAP;
-        packet.m_patchesBin->data->map = patchMap;
+        packet.m_patchesBin = NewBinField(arena, BinType::MAP, nullptr);
+        packet.m_patchesBin->data.map = patchMap;
 
         if (packet.m_isPatch && packet.m_Version >= 3)
         {
@@ -635,18 +987,16 @@ int main(int argc, char** argv)
                 patchMap->items.reserve(patchCount);
                 for (i = 0, obj = patches->child; obj != NULL; obj = obj->next, i++)
                 {
-                    PointerOrEmbed* embed = new PointerOrEmbed;
+                    PointerOrEmbed* embed = arena.New<PointerOrEmbed>(arena);
                     embed->name = patchFNV;
 
-                    BinField* embedValue = new BinField;
-                    embedValue->parent = packet.m_patchesBin;
-                    embedValue->type = BinType::EMBEDDED;
-                    embedValue->data->pe = embed;
+                    BinField* embedValue = NewBinField(arena, BinType::EMBEDDED, packet.m_patchesBin);
+                    embedValue->data.pe = embed;
+
+                    char* path = (char*)cJSON_GetObjectItem(obj, "path")->value;
 
-                    BinField* stringBin = new BinField;
-                    stringBin->parent = embedValue;
-                    stringBin->type = BinType::STRING;
-                    stringBin->data->string = (char*)cJSON_GetObjectItem(obj, "path")->value;
+                    BinField* stringBin = NewBinField(arena, BinType::STRING, embedValue);
+                    stringBin->data.string = arena.NewString(path, strlen(path));
 
                     EPField firstField;
                     firstField.key = pathFNV;
@@ -657,13 +1007,11 @@ int main(int argc, char** argv)
 
                     EPField secondField;
                     secondField.key = valueFNV;
-                    secondField.value = ReadValuerFomJsonValue(typebin, obj, 1);
+                    secondField.value = ReadValuerFomJsonValue(typebin, obj, 1, arena);
                     embed->items.emplace_back(secondField);
 
-                    BinField* hashKey = new BinField;
-                    hashKey->parent = packet.m_patchesBin;
-                    hashKey->type = BinType::HASH;
-                    hashKey->data->ui32 = HashFromString(obj->string);
+                    BinField* hashKey = NewBinField(arena, BinType::HASH, packet.m_patchesBin);
+                    hashKey->data.ui32 = HashFromString(obj->string);
 
                     MapPair pair;
                     pair.key = hashKey;